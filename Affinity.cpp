@@ -0,0 +1,119 @@
+//
+// Placement of the threads on CPUs and NUMA nodes
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Affinity.h"
+
+bool Affinity::Parse(const string &spec, vector<u_int> *cpus, string *error) {
+    cpus->clear();
+    stringstream items(spec);
+    for (string item; getline(items, item, ',');) {
+        if (item.compare(0, 4, "node") != 0) {
+            if (!ParseList(item, cpus, error)) return false;
+            continue;
+        }
+        string node = item.substr(4);
+        if (node.empty() || node.find_first_not_of("0123456789") != string::npos) {
+            *error = "invalid NUMA node: " + item;
+            return false;
+        }
+        ifstream file("/sys/devices/system/node/node" + node + "/cpulist");
+        string list;
+        if (!file || !getline(file, list)) {
+            *error = "no such NUMA node: " + item;
+            return false;
+        }
+        if (!ParseList(list, cpus, error)) return false;
+    }
+    if (cpus->empty()) {
+        *error = "no CPUs given";
+        return false;
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (u_int cpu : *cpus) {
+            if (CPU_ISSET(cpu, &set)) continue;
+            *error = "CPU " + to_string(cpu) + " is not available to this process";
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+bool Affinity::ParseList(const string &list, vector<u_int> *cpus, string *error) {
+    stringstream items(list);
+    for (string item; getline(items, item, ',');) {
+        while (!item.empty() && isspace(static_cast<unsigned char>(item.back()))) item.pop_back();
+        if (item.empty()) continue;
+        size_t dash = item.find('-');
+        string first = item.substr(0, dash);
+        string last = dash == string::npos ? first : item.substr(dash + 1);
+        if (first.empty() || last.empty() || first.find_first_not_of("0123456789") != string::npos ||
+            last.find_first_not_of("0123456789") != string::npos) {
+            *error = "invalid CPU: " + item;
+            return false;
+        }
+        u_int from = static_cast<u_int>(atoi(first.c_str()));
+        u_int to = static_cast<u_int>(atoi(last.c_str()));
+#ifdef __linux__
+        if (to >= CPU_SETSIZE) {
+            *error = "CPU out of range: " + item;
+            return false;
+        }
+#endif
+        if (from > to) {
+            *error = "invalid CPU range: " + item;
+            return false;
+        }
+        for (u_int cpu = from; cpu <= to; cpu++) {
+            if (find(cpus->begin(), cpus->end(), cpu) == cpus->end()) cpus->push_back(cpu);
+        }
+    }
+    return true;
+}
+
+bool Affinity::PinCurrentThread(const vector<u_int> &cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (u_int cpu : cpus) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+u_int Affinity::AvailableCpus() {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        return static_cast<u_int>(CPU_COUNT(&set));
+    }
+#endif
+    u_int cpus = thread::hardware_concurrency();
+    return cpus > 0 ? cpus : 1;
+}
+
+bool Affinity::IsSupported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,33 @@
+//
+// Placement of the threads on CPUs and NUMA nodes
+//
+
+#ifndef ESPERF_AFFINITY_H
+#define ESPERF_AFFINITY_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+using namespace std;
+
+class Affinity {
+public:
+    // Comma separated CPUs and ranges such as 0-3,8, where nodeN stands for the CPUs of the NUMA node N
+    static bool Parse(const string &spec, vector<u_int> *cpus, string *error);
+
+    // Bind the calling thread to the CPUs, false where the platform cannot
+    static bool PinCurrentThread(const vector<u_int> &cpus);
+
+    // CPUs the process may run on, as restricted by taskset or numactl
+    static u_int AvailableCpus();
+
+    // Thread placement is only supported on Linux
+    static bool IsSupported();
+
+private:
+    // A list of the kernel format, such as the cpulist of a NUMA node
+    static bool ParseList(const string &list, vector<u_int> *cpus, string *error);
+};
+
+#endif //ESPERF_AFFINITY_H
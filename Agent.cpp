@@ -0,0 +1,199 @@
+//
+// Agent running the workers for a coordinator connected over TCP
+//
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Agent.h"
+#include "Esperf.h"
+
+// Options a coordinator forwards, all but those it acts on itself and -A
+static const string FORWARDED_OPTIONS = "vaNgBXbcDdefHiKkLlmMnpPQqwTrRsStuxyz";
+// Longest secret taken, before the peer is known to be a coordinator
+static const uint64_t MAX_SECRET_SIZE = 1024;
+
+Agent::Agent(const string &host, const u_int port) : host_(host), port_(port) {}
+
+int Agent::Run() {
+    // A lost coordinator is noticed from the failed send
+    signal(SIGPIPE, SIG_IGN);
+
+    secret_ = Channel::Secret();
+    if (secret_.empty()) {
+        cout << "Error: set ESPERF_SECRET to the secret shared with the coordinator" << endl;
+        return EXIT_FAILURE;
+    }
+    string error;
+    int listen_fd = Channel::Listen(host_, port_, 1, &error);
+    if (listen_fd < 0) {
+        cout << "Error: " << error << endl;
+        return EXIT_FAILURE;
+    }
+    Log("waiting for a coordinator on " + host_ + ":" + to_string(port_));
+
+    while (true) {
+        sockaddr_storage peer;
+        socklen_t peer_length = sizeof(peer);
+        int fd = accept(listen_fd, reinterpret_cast<sockaddr *>(&peer), &peer_length);
+        if (fd < 0) continue;
+        char host[NI_MAXHOST];
+        char port[NI_MAXSERV];
+        if (getnameinfo(reinterpret_cast<sockaddr *>(&peer), peer_length, host, sizeof(host), port, sizeof(port),
+                        NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+            close(fd);
+            continue;
+        }
+        Channel channel;
+        channel.Attach(fd, string(host) + ":" + port);
+        Log("coordinator " + channel.Peer() + " connected");
+        if (Authenticate(&channel)) Serve(&channel);
+        Log("coordinator " + channel.Peer() + " disconnected");
+    }
+}
+
+bool Agent::Authenticate(Channel *channel) {
+    MessageType type;
+    string payload;
+    if (!channel->Receive(&type, &payload, MAX_SECRET_SIZE) || type != MSG_HELLO) return false;
+    if (!Channel::IsSameSecret(payload, secret_)) {
+        Log("Error: coordinator " + channel->Peer() + " gave a wrong secret");
+        channel->Send(MSG_ERROR, "wrong secret");
+        return false;
+    }
+    return channel->Send(MSG_READY, "");
+}
+
+void Agent::Serve(Channel *channel) {
+    MessageType type;
+    string payload;
+    if (!channel->Receive(&type, &payload) || type != MSG_SETUP) return;
+
+    Options options;
+    string directory;
+    string error;
+    bool ready = Setup(payload, &options, &directory, &error);
+    if (ready) {
+        channel->Send(MSG_READY, "");
+    } else {
+        Log("Error: " + error);
+        channel->Send(MSG_ERROR, error);
+    }
+
+    if (ready && channel->Receive(&type, &payload) && type == MSG_START) {
+        Log("starting " + to_string(options.num_threads_) + " threads");
+        Esperf esperf(&options);
+        Stats stats(&options, &mtx_for_cout_);
+        thread run(&Esperf::RunWorkers, &esperf, &stats);
+
+        // Answer the coordinator until it goes away, which ends the run if it is still going
+        while (channel->Receive(&type, &payload)) {
+            string reply;
+            Channel::PutNumber(&reply, stats.Finished() ? 1 : 0);
+            if (type == MSG_SNAPSHOT) {
+                Metrics metrics;
+                stats.Snapshot(&metrics);
+                metrics.Encode(&reply);
+            } else if (type != MSG_STATUS) {
+                break;
+            }
+            if (!channel->Send(type, reply)) break;
+        }
+        stats.Stop();
+        run.join();
+        Log("finished");
+    }
+
+    // The files handed over are only needed for the session
+    for (char file : string("fdS")) unlink((directory + "/" + file).c_str());
+    if (!directory.empty()) rmdir(directory.c_str());
+}
+
+bool Agent::Setup(const string &payload, Options *options, string *directory, string *error) {
+    size_t pos = 0;
+    uint64_t index;
+    uint64_t count;
+    uint64_t size;
+    if (!Channel::GetNumber(payload, &pos, &index) || !Channel::GetNumber(payload, &pos, &count) ||
+        !Channel::GetNumber(payload, &pos, &size) || count == 0) {
+        *error = "malformed setup";
+        return false;
+    }
+
+    char directory_template[] = "/tmp/esperf-agent-XXXXXX";
+    if (!mkdtemp(directory_template)) {
+        *error = string("cannot create a directory for the files: ") + strerror(errno);
+        return false;
+    }
+    *directory = directory_template;
+
+    vector<string> arguments = {"esperf"};
+    for (uint64_t i = 0; i < size; i++) {
+        string flag;
+        uint64_t is_file;
+        string value;
+        if (!Channel::GetString(payload, &pos, &flag) || !Channel::GetNumber(payload, &pos, &is_file) ||
+            !Channel::GetString(payload, &pos, &value) || flag.size() != 1) {
+            *error = "malformed setup";
+            return false;
+        }
+        if (FORWARDED_OPTIONS.find(flag) == string::npos) {
+            *error = "option -" + flag + " is not taken from a coordinator";
+            return false;
+        }
+        arguments.push_back("-" + flag);
+        if (is_file) {
+            string path = *directory + "/" + flag;
+            ofstream file(path, ios::binary);
+            file << value;
+            if (!file) {
+                *error = "cannot write " + path;
+                return false;
+            }
+            value = path;
+        }
+        // Flags without an argument have an empty value
+        if (!value.empty()) arguments.push_back(value);
+    }
+    string url;
+    if (!Channel::GetString(payload, &pos, &url) || !Channel::GetString(payload, &pos, &options->request_body_)) {
+        *error = "malformed setup";
+        return false;
+    }
+    arguments.push_back(url);
+    options->read_stdin_ = false;
+
+    vector<char *> argv;
+    for (string &argument : arguments) argv.push_back(&argument[0]);
+    argv.push_back(nullptr);
+
+    // Parse tells of the errors on cout, which are handed back to the coordinator
+    optind = 1;
+#ifdef __APPLE__
+    optreset = 1;
+#endif
+    stringstream messages;
+    streambuf *console = cout.rdbuf(messages.rdbuf());
+    options->agent_ = true;
+    int parsed = options->Parse(static_cast<int>(argv.size() - 1), argv.data());
+    cout.rdbuf(console);
+    if (parsed != EXIT_SUCCESS) {
+        *error = messages.str();
+        while (!error->empty() && error->back() == '\n') error->pop_back();
+        return false;
+    }
+    return options->Share(static_cast<u_int>(index), static_cast<u_int>(count), error);
+}
+
+void Agent::Log(const string &msg) {
+    char time_buff[80];
+    time_t now_t = time(NULL);
+    strftime(time_buff, sizeof(time_buff), "%FT%T%z", localtime(&now_t));
+    lock_guard<mutex> lock(mtx_for_cout_);
+    cout << time_buff << " " << msg << endl;
+}
@@ -0,0 +1,43 @@
+//
+// Agent running the workers for a coordinator connected over TCP
+//
+
+#ifndef ESPERF_AGENT_H
+#define ESPERF_AGENT_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Channel.h"
+#include "Options.h"
+
+using namespace std;
+
+class Agent {
+public:
+    Agent(const string &host, const u_int port);
+
+    // Serve one coordinator after another, return only if the port cannot be listened on or no secret is set
+    int Run();
+
+private:
+    string host_;
+    u_int port_;
+    string secret_;
+    mutex mtx_for_cout_;
+
+    // Run the session of a coordinator until it disconnects
+    void Serve(Channel *channel);
+
+    // Take the secret of the coordinator before anything else it sends
+    bool Authenticate(Channel *channel);
+
+    // Parse the options handed over, with the files written into a directory of its own. Only the options a
+    // coordinator forwards are taken, so that a peer cannot have the agent write anywhere else
+    bool Setup(const string &payload, Options *options, string *directory, string *error);
+
+    void Log(const string &msg);
+};
+
+#endif //ESPERF_AGENT_H
@@ -0,0 +1,79 @@
+//
+// Client-side load balancing over the nodes of a cluster
+//
+
+#include "Balancer.h"
+
+bool Balancer::ParsePolicy(const string &name, Policy *policy) {
+    if (name == "rr") {
+        *policy = ROUND_ROBIN;
+    } else if (name == "random") {
+        *policy = RANDOM;
+    } else if (name == "least") {
+        *policy = LEAST_OUTSTANDING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+string Balancer::PolicyName(const Policy policy) {
+    switch (policy) {
+        case RANDOM:
+            return "random";
+        case LEAST_OUTSTANDING:
+            return "least";
+        default:
+            return "rr";
+    }
+}
+
+Balancer::Balancer(const vector<string> &nodes, const Policy policy) : nodes_(nodes), policy_(policy) {
+    for (size_t i = 0; i < nodes_.size(); i++) {
+        outstanding_.push_back(unique_ptr<Outstanding>(new Outstanding()));
+    }
+}
+
+size_t Balancer::Size() const {
+    return nodes_.size();
+}
+
+size_t Balancer::Acquire(Random *random, size_t *cursor) {
+    size_t node = 0;
+    switch (policy_) {
+        case RANDOM:
+            node = random->Uniform(nodes_.size());
+            break;
+        case LEAST_OUTSTANDING: {
+            // Start the scan at the cursor, so that ties rotate instead of piling on the first node
+            long least = -1;
+            for (size_t i = 0; i < nodes_.size(); i++) {
+                size_t candidate = (*cursor + i) % nodes_.size();
+                long count = outstanding_[candidate]->count.load(memory_order_relaxed);
+                if (least < 0 || count < least) {
+                    least = count;
+                    node = candidate;
+                }
+            }
+            *cursor = node + 1;
+            break;
+        }
+        default:
+            node = *cursor % nodes_.size();
+            *cursor = node + 1;
+    }
+    if (policy_ == LEAST_OUTSTANDING) outstanding_[node]->count.fetch_add(1, memory_order_relaxed);
+    return node;
+}
+
+void Balancer::Release(const size_t node) {
+    if (policy_ == LEAST_OUTSTANDING) outstanding_[node]->count.fetch_sub(1, memory_order_relaxed);
+}
+
+void Balancer::Route(const size_t node, string *url) const {
+    // The origin ends at the first slash or query after the scheme, the whole URL if there is neither
+    size_t scheme = url->find("://");
+    size_t start = scheme == string::npos ? 0 : scheme + 3;
+    size_t end = url->find_first_of("/?", start);
+    url->replace(0, end == string::npos ? url->size() : end, nodes_[node]);
+}
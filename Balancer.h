@@ -0,0 +1,53 @@
+//
+// Client-side load balancing over the nodes of a cluster
+//
+
+#ifndef ESPERF_BALANCER_H
+#define ESPERF_BALANCER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Metrics.h"
+#include "Random.h"
+
+using namespace std;
+
+class Balancer {
+public:
+    enum Policy { ROUND_ROBIN, RANDOM, LEAST_OUTSTANDING };
+
+    // rr, random or least
+    static bool ParsePolicy(const string &name, Policy *policy);
+
+    static string PolicyName(const Policy policy);
+
+    Balancer(const vector<string> &nodes, const Policy policy);
+
+    size_t Size() const;
+
+    // Pick the node of the next request, cursor is the round-robin position of the calling worker
+    size_t Acquire(Random *random, size_t *cursor);
+
+    // The request to the node has completed
+    void Release(const size_t node);
+
+    // Send the request to the node, replacing the scheme, host and port of the URL
+    void Route(const size_t node, string *url) const;
+
+private:
+    // Requests in flight to a node over all the workers
+    struct Outstanding {
+        char padding_head[CACHE_LINE_SIZE];
+        atomic<long> count{0};
+        char padding_tail[CACHE_LINE_SIZE];
+    };
+
+    vector<string> nodes_;
+    Policy policy_;
+    vector<unique_ptr<Outstanding>> outstanding_;
+};
+
+#endif //ESPERF_BALANCER_H
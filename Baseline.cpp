@@ -0,0 +1,123 @@
+//
+// Regression check of a run against the summary of a previous one
+//
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "Baseline.h"
+#include "Json.h"
+
+static const string BASELINE_HEADER = "----------------------------------- Baseline -----------------------------------";
+static const int NAME_WIDTH = 24;
+static const int VALUE_WIDTH = 15;
+static const int CHANGE_WIDTH = 10;
+
+// Higher is better for a throughput, lower for the others
+static bool IsThroughput(const string &name) {
+    static const string SUFFIX = "_per_sec";
+    return name.size() >= SUFFIX.size() && name.compare(name.size() - SUFFIX.size(), SUFFIX.size(), SUFFIX) == 0;
+}
+
+bool Baseline::Load(const string &filename, string *error) {
+    ifstream if_baseline(filename);
+    if (!if_baseline) {
+        *error = "cannot open " + filename;
+        return false;
+    }
+
+    bool found = false;
+    for (string str_line; getline(if_baseline, str_line);) {
+        map<string, JsonValue> members;
+        string parse_error;
+        if (!Json::ParseObject(str_line, &members, &parse_error)) continue;
+        if (!members.count("type") || members["type"].text != "summary") continue;
+
+        // A later summary replaces an earlier one, when runs are appended to a file
+        values_.clear();
+        for (auto &member : members) {
+            if (member.second.type == JsonValue::NUMBER) values_[member.first] = atof(member.second.text.c_str());
+        }
+        found = true;
+    }
+    if (!found) {
+        *error = filename + ": no summary record, a JSON lines result file of -o is expected";
+        return false;
+    }
+    filename_ = filename;
+    return true;
+}
+
+bool Baseline::SetThresholds(const string &spec, string *error) {
+    thresholds_.clear();
+    stringstream items(spec);
+    for (string item; getline(items, item, ',');) {
+        if (item.empty()) continue;
+        size_t equal = item.find('=');
+        if (equal == string::npos || equal == 0) {
+            *error = "threshold must be name=percent: " + item;
+            return false;
+        }
+        double percent = atof(item.substr(equal + 1).c_str());
+        if (percent < 0) {
+            *error = "threshold must not be negative: " + item;
+            return false;
+        }
+        thresholds_.push_back(make_pair(item.substr(0, equal), percent));
+    }
+    return true;
+}
+
+bool Baseline::IsLoaded() const {
+    return !filename_.empty();
+}
+
+const string &Baseline::Filename() const {
+    return filename_;
+}
+
+bool Baseline::Check(const Record &summary, string *out) const {
+    stringstream msg;
+    msg << BASELINE_HEADER << endl;
+    msg << setw(NAME_WIDTH) << left << "Field" << right << setw(VALUE_WIDTH) << "Baseline" << setw(VALUE_WIDTH)
+        << "Current" << setw(CHANGE_WIDTH) << "Change%" << setw(CHANGE_WIDTH) << "Limit%" << "  Result" << endl;
+
+    bool passed = true;
+    for (auto &threshold : thresholds_) {
+        const string &name = threshold.first;
+        double current = 0.0;
+        auto baseline = values_.find(name);
+        if (baseline == values_.end() || !summary.Number(name, &current)) {
+            msg << setw(NAME_WIDTH) << left << name << right << "  missing in the "
+                << (baseline == values_.end() ? "baseline" : "results") << endl;
+            passed = false;
+            continue;
+        }
+
+        // Change for the worse in percent of the baseline. Any rise from a baseline of 0 is an infinite change, a
+        // failure unless higher is better
+        bool ok;
+        stringstream change;
+        change << fixed << setprecision(1) << showpos;
+        if (baseline->second != 0) {
+            double percent = (current - baseline->second) / baseline->second * 100.0;
+            ok = (IsThroughput(name) ? -percent : percent) <= threshold.second;
+            change << percent;
+        } else if (current != 0) {
+            ok = IsThroughput(name) ? current > 0 : current < 0;
+            change << (current > 0 ? "+inf" : "-inf");
+        } else {
+            ok = true;
+            change << 0.0;
+        }
+        passed = passed && ok;
+        msg << setw(NAME_WIDTH) << left << name << right << fixed << setprecision(5) << setw(VALUE_WIDTH)
+            << baseline->second << setw(VALUE_WIDTH) << current << setw(CHANGE_WIDTH) << change.str() << setprecision(1)
+            << showpos << setw(CHANGE_WIDTH) << (IsThroughput(name) ? -threshold.second : threshold.second)
+            << noshowpos << "  " << (ok ? "PASS" : "FAIL") << endl;
+    }
+    *out = msg.str();
+    return passed;
+}
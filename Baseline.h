@@ -0,0 +1,38 @@
+//
+// Regression check of a run against the summary of a previous one
+//
+
+#ifndef ESPERF_BASELINE_H
+#define ESPERF_BASELINE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Report.h"
+
+using namespace std;
+
+class Baseline {
+public:
+    // Read the last summary record of a JSON lines result file
+    bool Load(const string &filename, string *error);
+
+    // Comma separated name=percent of the summary fields, a throughput (*_per_sec) fails if it drops by more than
+    // the percent and any other field, such as a latency, if it rises by more
+    bool SetThresholds(const string &spec, string *error);
+
+    bool IsLoaded() const;
+
+    const string &Filename() const;
+
+    // Compare the summary of this run, write a table to out, return false if any threshold is crossed
+    bool Check(const Record &summary, string *out) const;
+
+private:
+    string filename_;
+    map<string, double> values_;
+    vector<pair<string, double>> thresholds_;
+};
+
+#endif //ESPERF_BASELINE_H
@@ -0,0 +1,132 @@
+//
+// Microbenchmarks of the work esperf does for every request and every progress line
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "Options.h"
+#include "Stats.h"
+#include "Template.h"
+#include "ResponseScanner.h"
+#include "Metrics.h"
+#include "Histogram.h"
+#include "Random.h"
+
+using namespace std;
+
+static const string COMMAND_LINE_OPTIONS_MSG = "Usage: esperf-bench [-h] [-i iterations] [-t num_threads] [-f filter]";
+
+static const string SEARCH_TEMPLATE = "{\"query\":{\"bool\":{\"filter\":[{\"term\":{\"user_id\":$RNUM[1000000]}},{\"range\":{\"age\":{\"gte\":$RNUM[100]}}}]}},\"size\":$RNUM[100]}";
+static const string GENERATORS_TEMPLATE = "{\"query\":{\"bool\":{\"filter\":[{\"range\":{\"price\":{\"gte\":$RFLOAT(0,100)}}},{\"range\":{\"@timestamp\":{\"gte\":\"$RDATE(-7d,-1d)\"}}},{\"term\":{\"shard\":$RRANGE(-5,5)}}]}},\"stats\":[\"$UUID\",\"$SEQ\"]}";
+static const string SEARCH_RESPONSE = "{\"took\":12,\"timed_out\":false,\"_shards\":{\"total\":5,\"successful\":5,\"skipped\":0,\"failed\":0},\"hits\":{\"total\":{\"value\":10000,\"relation\":\"gte\"},\"max_score\":1.0,\"hits\":[{\"_index\":\"test\",\"_id\":\"1\",\"_score\":1.0,\"_source\":{\"user_id\":42,\"message\":\"trying out Elasticsearch\",\"tags\":[\"a\",\"b\",\"c\"]}}]}}";
+
+// Run the body the given number of times and print the time per call
+static void Measure(const string &name, const string &filter, u_long iterations, const function<void()> &body) {
+    if (!filter.empty() && name.find(filter) == string::npos) return;
+    // A short warm-up fills the caches and grows the buffers
+    for (u_long i = 0; i < iterations / 100 + 1; i++) body();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (u_long i = 0; i < iterations; i++) body();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double ns = elapsed * 1e9 / iterations;
+    cout << left << setw(32) << name << right << setw(12) << fixed << setprecision(1) << ns << " ns/op"
+         << setw(14) << setprecision(0) << 1e9 / ns << " ops/sec" << endl;
+}
+
+int main(int argc, char **argv) {
+    u_long iterations = 1000000;
+    u_int num_threads = 8;
+    string filter;
+    int opt;
+    while ((opt = getopt(argc, argv, "hi:t:f:")) != EOF)
+        switch (opt) {
+            case 'i':
+                iterations = static_cast<u_long>(atol(optarg));
+                break;
+            case 't':
+                num_threads = static_cast<u_int>(atoi(optarg));
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                cout << COMMAND_LINE_OPTIONS_MSG << endl;
+                return EXIT_FAILURE;
+        }
+    if (iterations < 1) iterations = 1;
+    if (num_threads < 1) num_threads = 1;
+
+    Random random(1);
+    u_long sequence = 0;
+    string buffer;
+
+    // Rendering of the request bodies
+    Template static_template;
+    static_template.Compile("{\"query\":{\"match_all\":{}}}", nullptr);
+    Measure("template/static", filter, iterations, [&]() { static_template.Render(&random, &sequence, &buffer); });
+
+    Template search_template;
+    search_template.Compile(SEARCH_TEMPLATE, nullptr);
+    Measure("template/rnum", filter, iterations, [&]() { search_template.Render(&random, &sequence, &buffer); });
+
+    Template generators_template;
+    generators_template.Compile(GENERATORS_TEMPLATE, nullptr);
+    Measure("template/generators", filter, iterations, [&]() {
+        generators_template.Render(&random, &sequence, &buffer);
+    });
+
+    // Scanning of the response bodies
+    ResponseScanner scanner;
+    Measure("scanner/search", filter, iterations, [&]() {
+        scanner.Reset();
+        scanner.Scan(SEARCH_RESPONSE.data(), SEARCH_RESPONSE.size());
+    });
+
+    // Recording of the results into the slot of a worker
+    Options options;
+    options.num_threads_ = num_threads;
+    mutex mtx_for_cout;
+    Stats stats(&options, &mtx_for_cout);
+    RequestResult result;
+    result.success = 1;
+    result.size_upload = 120;
+    result.size_download = 480;
+    for (int i = 0; i < PHASE_COUNT; i++) result.time_phases[i] = 0.0001;
+    Measure("stats/count_result", filter, iterations, [&]() {
+        result.time_transfer = result.time_response = 0.0005 + random.NextDouble() * 0.01;
+        stats.CountResult(0, result);
+    });
+
+    // Merging of the worker slots for a progress line, which runs once a second
+    vector<unique_ptr<MetricsSlot>> slots;
+    for (u_int i = 0; i < num_threads; i++) {
+        slots.push_back(unique_ptr<MetricsSlot>(new MetricsSlot()));
+        for (int j = 0; j < 1000; j++) slots.back()->response.Record(random.Uniform(100000));
+    }
+    Metrics prev;
+    u_long progress_iterations = iterations / 1000 + 1;
+    Measure("progress/merge_" + to_string(num_threads) + "_slots", filter, progress_iterations, [&]() {
+        Metrics current;
+        for (auto &slot : slots) current.Add(*slot);
+        Metrics interval = current;
+        interval.Subtract(prev);
+        prev = current;
+    });
+
+    Histogram histogram;
+    for (u_long i = 0; i < 100000; i++) histogram.Record(random.Uniform(1000000));
+    Measure("histogram/percentiles", filter, progress_iterations, [&]() {
+        static const double PERCENTILES[] = {50, 90, 99, 99.9};
+        for (double p : PERCENTILES) histogram.ValueAtPercentile(p);
+    });
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+//
+// Framed messages between the coordinator and the agents over TCP
+//
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Channel.h"
+
+#ifndef MSG_NOSIGNAL
+// SIGPIPE is ignored instead where send() has no such flag
+#define MSG_NOSIGNAL 0
+#endif
+
+// Type byte and the length of the payload
+static const size_t FRAME_HEADER_SIZE = 9;
+static const char *LOOPBACK_HOST = "127.0.0.1";
+static const char *SECRET_VARIABLE = "ESPERF_SECRET";
+
+Channel::~Channel() {
+    Close();
+}
+
+bool Channel::Connect(const string &address, string *error) {
+    string host = address;
+    string port = to_string(DEFAULT_PORT);
+    size_t colon = address.rfind(':');
+    if (colon != string::npos) {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = NULL;
+    int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (status != 0) {
+        *error = "cannot resolve " + address + ": " + gai_strerror(status);
+        return false;
+    }
+    for (addrinfo *ai = result; ai; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            freeaddrinfo(result);
+            Attach(fd, address);
+            return true;
+        }
+        close(fd);
+    }
+    freeaddrinfo(result);
+    *error = "cannot connect to " + address + ": " + strerror(errno);
+    return false;
+}
+
+void Channel::Attach(int fd, const string &peer) {
+    Close();
+    fd_ = fd;
+    peer_ = peer;
+    // Requests and replies are small and wait for each other
+    int on = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+void Channel::Close() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+}
+
+bool Channel::IsOpen() const {
+    return fd_ >= 0;
+}
+
+const string &Channel::Peer() const {
+    return peer_;
+}
+
+bool Channel::Send(MessageType type, const string &payload) {
+    string header(1, static_cast<char>(type));
+    PutNumber(&header, payload.size());
+    return WriteAll(header.data(), header.size()) && WriteAll(payload.data(), payload.size());
+}
+
+bool Channel::Receive(MessageType *type, string *payload, uint64_t max_length) {
+    char header[FRAME_HEADER_SIZE];
+    if (!ReadAll(header, sizeof(header))) return false;
+    *type = static_cast<MessageType>(header[0]);
+    uint64_t length;
+    size_t pos = 1;
+    GetNumber(string(header, sizeof(header)), &pos, &length);
+    if (length > max_length) return false;
+    payload->resize(length);
+    return length == 0 || ReadAll(&(*payload)[0], length);
+}
+
+void Channel::PutNumber(string *out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) out->push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+void Channel::PutDouble(string *out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutNumber(out, bits);
+}
+
+void Channel::PutString(string *out, const string &value) {
+    PutNumber(out, value.size());
+    out->append(value);
+}
+
+bool Channel::GetNumber(const string &in, size_t *pos, uint64_t *value) {
+    if (in.size() < *pos + 8) return false;
+    *value = 0;
+    for (int i = 0; i < 8; i++) *value = (*value << 8) | static_cast<unsigned char>(in[*pos + i]);
+    *pos += 8;
+    return true;
+}
+
+bool Channel::GetDouble(const string &in, size_t *pos, double *value) {
+    uint64_t bits;
+    if (!GetNumber(in, pos, &bits)) return false;
+    memcpy(value, &bits, sizeof(bits));
+    return true;
+}
+
+bool Channel::GetString(const string &in, size_t *pos, string *value) {
+    uint64_t length;
+    if (!GetNumber(in, pos, &length) || in.size() - *pos < length) return false;
+    value->assign(in, *pos, length);
+    *pos += length;
+    return true;
+}
+
+bool Channel::ParseListenAddress(const string &address, string *host, u_int *port) {
+    *host = LOOPBACK_HOST;
+    string number = address;
+    size_t colon = address.rfind(':');
+    if (colon != string::npos) {
+        *host = address.substr(0, colon);
+        number = address.substr(colon + 1);
+    }
+    // [::1]:9400 for an IPv6 address
+    if (host->size() > 1 && host->front() == '[' && host->back() == ']') *host = host->substr(1, host->size() - 2);
+    int value = atoi(number.c_str());
+    if (host->empty() || value <= 0 || value > 65535) return false;
+    *port = static_cast<u_int>(value);
+    return true;
+}
+
+int Channel::Listen(const string &host, u_int port, int backlog, string *error) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *result = NULL;
+    int status = getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &result);
+    if (status != 0) {
+        *error = "cannot resolve " + host + ": " + gai_strerror(status);
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *ai = result; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, backlog) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd < 0) *error = "cannot listen on " + host + ":" + to_string(port) + ": " + strerror(errno);
+    return fd;
+}
+
+string Channel::Secret() {
+    const char *secret = getenv(SECRET_VARIABLE);
+    return secret ? string(secret) : string();
+}
+
+bool Channel::IsSameSecret(const string &given, const string &expected) {
+    if (expected.empty() || given.size() != expected.size()) return false;
+    unsigned char difference = 0;
+    for (size_t i = 0; i < given.size(); i++) difference |= static_cast<unsigned char>(given[i] ^ expected[i]);
+    return difference == 0;
+}
+
+bool Channel::WriteAll(const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd_, data, length, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool Channel::ReadAll(char *data, size_t length) {
+    while (length > 0) {
+        ssize_t read = recv(fd_, data, length, 0);
+        if (read < 0 && errno == EINTR) continue;
+        if (read <= 0) return false;
+        data += read;
+        length -= static_cast<size_t>(read);
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+//
+// Framed messages between the coordinator and the agents over TCP
+//
+
+#ifndef ESPERF_CHANNEL_H
+#define ESPERF_CHANNEL_H
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+using namespace std;
+
+enum MessageType : uint8_t {
+    // Coordinator to agent: options, files and the share of the load, answered by READY or ERROR
+    MSG_SETUP = 1,
+    MSG_READY,
+    MSG_ERROR,
+    // Coordinator to agent: start the workers
+    MSG_START,
+    // Coordinator to agent and back: whether the run has finished
+    MSG_STATUS,
+    // Coordinator to agent and back: whether the run has finished, and the counters so far
+    MSG_SNAPSHOT,
+    // Coordinator to agent before the setup: the shared secret, answered by READY or ERROR
+    MSG_HELLO
+};
+
+class Channel {
+public:
+    Channel() = default;
+
+    Channel(const Channel &) = delete;
+
+    Channel &operator=(const Channel &) = delete;
+
+    ~Channel();
+
+    // host:port, the port defaults to DEFAULT_PORT
+    bool Connect(const string &address, string *error);
+
+    // Take over an accepted socket
+    void Attach(int fd, const string &peer);
+
+    void Close();
+
+    bool IsOpen() const;
+
+    const string &Peer() const;
+
+    bool Send(MessageType type, const string &payload);
+
+    // False as well for a payload longer than max_length, which is not read
+    bool Receive(MessageType *type, string *payload, uint64_t max_length = MAX_FRAME_SIZE);
+
+    // Numbers are written in 8 bytes in network order, and strings after their length
+    static void PutNumber(string *out, uint64_t value);
+
+    static void PutDouble(string *out, double value);
+
+    static void PutString(string *out, const string &value);
+
+    static bool GetNumber(const string &in, size_t *pos, uint64_t *value);
+
+    static bool GetDouble(const string &in, size_t *pos, double *value);
+
+    static bool GetString(const string &in, size_t *pos, string *value);
+
+    // [host:]port to listen on, the host defaults to the loopback address
+    static bool ParseListenAddress(const string &address, string *host, u_int *port);
+
+    // Socket listening on host:port, -1 with the error if it cannot be opened
+    static int Listen(const string &host, u_int port, int backlog, string *error);
+
+    // Secret shared by the coordinator and the agents, from the ESPERF_SECRET environment variable
+    static string Secret();
+
+    // Compare secrets in a time which does not tell how much of them matches
+    static bool IsSameSecret(const string &given, const string &expected);
+
+    static const int DEFAULT_PORT = 9400;
+
+    // Largest payload accepted, beyond which the peer is taken as broken rather than allocated for
+    static const uint64_t MAX_FRAME_SIZE = 256ULL << 20;
+
+private:
+    int fd_ = -1;
+    string peer_;
+
+    bool WriteAll(const char *data, size_t length);
+
+    bool ReadAll(char *data, size_t length);
+};
+
+#endif //ESPERF_CHANNEL_H
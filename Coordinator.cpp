@@ -0,0 +1,182 @@
+//
+// Coordinator of agents which run the workers on other processes or machines
+//
+
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "Coordinator.h"
+
+// Options only the coordinator acts on: agents, output, baseline and the seed, which it gives itself
+static const string COORDINATOR_OPTIONS = "WAoFCGs";
+// Options naming a file, whose contents are handed over. The replay log is not among them, it may be far larger than
+// memory and each agent streams it from its own copy
+static const string FILE_OPTIONS = "fdS";
+
+static const chrono::milliseconds POLL_INTERVAL(100);
+
+Coordinator::Coordinator(Options *options, mutex *mtx_for_cout) : options_(options), mtx_for_cout_(mtx_for_cout) {}
+
+bool Coordinator::Setup() {
+    // A lost agent is noticed from the failed send
+    signal(SIGPIPE, SIG_IGN);
+
+    string secret = Channel::Secret();
+    if (secret.empty()) {
+        cout << "Error: set ESPERF_SECRET to the secret shared with the agents" << endl;
+        return false;
+    }
+    for (u_int i = 0; i < options_->agents_.size(); i++) {
+        string error;
+        string payload;
+        peers_.push_back(unique_ptr<Peer>(new Peer()));
+        Channel &channel = peers_.back()->channel;
+        if (!BuildSetup(i, &payload, &error) || !channel.Connect(options_->agents_[i], &error) ||
+            !Authenticate(&channel, secret, &error) || !channel.Send(MSG_SETUP, payload)) {
+            cout << "Error: " << (error.empty() ? "cannot reach agent " + options_->agents_[i] : error) << endl;
+            return false;
+        }
+    }
+
+    // The agents load the files and parse the options at the same time
+    bool ready = true;
+    for (auto &peer : peers_) {
+        MessageType type;
+        string payload;
+        if (!peer->channel.Receive(&type, &payload)) {
+            cout << "Error: agent " << peer->channel.Peer() << " closed the connection" << endl;
+            ready = false;
+        } else if (type != MSG_READY) {
+            cout << "Error: agent " << peer->channel.Peer() << ": " << payload << endl;
+            ready = false;
+        }
+    }
+    return ready;
+}
+
+void Coordinator::Start() {
+    lock_guard<mutex> lock(mtx_peers_);
+    for (auto &peer : peers_) {
+        if (!peer->channel.Send(MSG_START, "")) Lose(peer.get(), "closed the connection");
+    }
+}
+
+void Coordinator::Collect(Metrics *metrics) {
+    lock_guard<mutex> lock(mtx_peers_);
+    // Ask all the agents first, so that they take their snapshots at about the same time
+    for (auto &peer : peers_) {
+        if (peer->channel.IsOpen() && !peer->channel.Send(MSG_SNAPSHOT, "")) Lose(peer.get(), "closed the connection");
+    }
+    for (auto &peer : peers_) {
+        if (peer->channel.IsOpen()) {
+            MessageType type;
+            string payload;
+            size_t pos = 0;
+            uint64_t finished;
+            Metrics snapshot;
+            if (!peer->channel.Receive(&type, &payload) || type != MSG_SNAPSHOT ||
+                !Channel::GetNumber(payload, &pos, &finished) || !snapshot.Decode(payload, &pos)) {
+                Lose(peer.get(), "sent no counters");
+            } else {
+                peer->finished = finished != 0;
+                peer->last = snapshot;
+            }
+        }
+        metrics->Add(peer->last);
+    }
+}
+
+void Coordinator::WaitUntilFinished() {
+    while (true) {
+        {
+            lock_guard<mutex> lock(mtx_peers_);
+            for (auto &peer : peers_) {
+                if (peer->channel.IsOpen() && !peer->channel.Send(MSG_STATUS, "")) {
+                    Lose(peer.get(), "closed the connection");
+                }
+            }
+            bool finished = true;
+            for (auto &peer : peers_) {
+                if (!peer->channel.IsOpen()) continue;
+                MessageType type;
+                string payload;
+                size_t pos = 0;
+                uint64_t status;
+                if (!peer->channel.Receive(&type, &payload) || type != MSG_STATUS ||
+                    !Channel::GetNumber(payload, &pos, &status)) {
+                    Lose(peer.get(), "closed the connection");
+                    continue;
+                }
+                peer->finished = status != 0;
+                if (!peer->finished) finished = false;
+            }
+            if (finished) return;
+        }
+        this_thread::sleep_for(POLL_INTERVAL);
+    }
+}
+
+bool Coordinator::BuildSetup(u_int index, string *payload, string *error) {
+    Channel::PutNumber(payload, index);
+    Channel::PutNumber(payload, options_->agents_.size());
+
+    vector<pair<char, string>> arguments;
+    for (const pair<char, string> &argument : options_->arguments_) {
+        if (COORDINATOR_OPTIONS.find(argument.first) == string::npos) arguments.push_back(argument);
+    }
+    // Every agent starts from the seed of the coordinator, so that the run can be repeated as a whole
+    arguments.push_back(make_pair('s', to_string(options_->seed_)));
+
+    Channel::PutNumber(payload, arguments.size());
+    for (const pair<char, string> &argument : arguments) {
+        Channel::PutString(payload, string(1, argument.first));
+        if (FILE_OPTIONS.find(argument.first) == string::npos) {
+            Channel::PutNumber(payload, 0);
+            Channel::PutString(payload, argument.second);
+            continue;
+        }
+        ifstream file(argument.second, ios::binary);
+        if (!file) {
+            *error = "cannot open " + argument.second;
+            return false;
+        }
+        stringstream contents;
+        contents << file.rdbuf();
+        Channel::PutNumber(payload, 1);
+        Channel::PutString(payload, contents.str());
+    }
+    Channel::PutString(payload, options_->request_url_);
+    Channel::PutString(payload, options_->request_body_);
+    if (payload->size() > Channel::MAX_FRAME_SIZE) {
+        *error = "the options, files and body for the agents exceed " + to_string(Channel::MAX_FRAME_SIZE >> 20) +
+                 " MB";
+        return false;
+    }
+    return true;
+}
+
+bool Coordinator::Authenticate(Channel *channel, const string &secret, string *error) {
+    MessageType type;
+    string payload;
+    if (!channel->Send(MSG_HELLO, secret) || !channel->Receive(&type, &payload)) return false;
+    if (type != MSG_READY) {
+        *error = "agent " + channel->Peer() + ": " + payload;
+        return false;
+    }
+    return true;
+}
+
+// Stop asking the agent, its last counters stay in the results
+void Coordinator::Lose(Peer *peer, const string &reason) {
+    peer->channel.Close();
+    peer->finished = true;
+    safe_cerr("Error: agent " + peer->channel.Peer() + " " + reason + "\n");
+}
+
+void Coordinator::safe_cerr(const string msg) {
+    lock_guard<mutex> lock(*mtx_for_cout_);
+    cerr << msg;
+}
@@ -0,0 +1,60 @@
+//
+// Coordinator of agents which run the workers on other processes or machines
+//
+
+#ifndef ESPERF_COORDINATOR_H
+#define ESPERF_COORDINATOR_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Options.h"
+#include "Metrics.h"
+#include "Channel.h"
+
+using namespace std;
+
+class Coordinator {
+public:
+    Coordinator(Options *options, mutex *mtx_for_cout);
+
+    // Connect to all the agents and hand over the options, the files and the body, return false unless all of
+    // them are ready
+    bool Setup();
+
+    // Start the workers of all the agents at once
+    void Start();
+
+    // Merge the counters of all the agents, an agent lost keeps its last ones
+    void Collect(Metrics *metrics);
+
+    // Poll the agents until all of them have finished their runs or are lost
+    void WaitUntilFinished();
+
+private:
+    struct Peer {
+        Channel channel;
+        bool finished = false;
+        Metrics last;
+    };
+
+    Options *options_;
+    mutex *mtx_for_cout_;
+    // Requests and replies of the timer and the main thread take turns
+    mutex mtx_peers_;
+    vector<unique_ptr<Peer>> peers_;
+
+    // Setup message for the agent at index
+    bool BuildSetup(u_int index, string *payload, string *error);
+
+    // Hand the shared secret over, which the agent takes before the setup
+    bool Authenticate(Channel *channel, const string &secret, string *error);
+
+    void Lose(Peer *peer, const string &reason);
+
+    void safe_cerr(const string msg);
+};
+
+#endif //ESPERF_COORDINATOR_H
@@ -0,0 +1,209 @@
+//
+// Memory-mapped dictionary of terms with a skewed selection
+//
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Dictionary.h"
+
+// log(1 + x) / x, accurate near 0
+static double Helper1(const double x) {
+    if (fabs(x) > 1e-8) return log1p(x) / x;
+    return 1 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+// (exp(x) - 1) / x, accurate near 0
+static double Helper2(const double x) {
+    if (fabs(x) > 1e-8) return expm1(x) / x;
+    return 1 + x * 0.5 * (1 + x * 1.0 / 3.0 * (1 + 0.25 * x));
+}
+
+Dictionary::~Dictionary() {
+    if (data_) munmap(const_cast<char *>(data_), length_);
+}
+
+bool Dictionary::Load(const string &filename, string *error) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        *error = "cannot open " + filename;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        *error = "cannot stat " + filename;
+        return false;
+    }
+    length_ = static_cast<size_t>(st.st_size);
+    if (length_ == 0) {
+        close(fd);
+        return true;
+    }
+
+    void *mapped = mmap(NULL, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        length_ = 0;
+        *error = "cannot map " + filename;
+        return false;
+    }
+    data_ = static_cast<const char *>(mapped);
+
+    // Count the lines first, so that the index is allocated once
+    size_t lines = 0;
+    for (const char *p = data_; p < data_ + length_; p++) {
+        p = static_cast<const char *>(memchr(p, '\n', data_ + length_ - p));
+        if (!p) break;
+        lines++;
+    }
+    if (data_[length_ - 1] != '\n') lines++;
+    size_ = lines;
+
+    // The end of the last line is kept as if it had a newline
+    size_t end = data_[length_ - 1] == '\n' ? length_ : length_ + 1;
+    bool wide = end > UINT32_MAX;
+    if (wide) {
+        offsets64_.reserve(size_ + 1);
+    } else {
+        offsets32_.reserve(size_ + 1);
+    }
+    const char *p = data_;
+    for (size_t i = 0; i < size_; i++) {
+        size_t offset = static_cast<size_t>(p - data_);
+        if (wide) {
+            offsets64_.push_back(offset);
+        } else {
+            offsets32_.push_back(static_cast<uint32_t>(offset));
+        }
+        const char *newline = static_cast<const char *>(memchr(p, '\n', data_ + length_ - p));
+        p = newline ? newline + 1 : data_ + length_;
+    }
+    if (wide) {
+        offsets64_.push_back(end);
+    } else {
+        offsets32_.push_back(static_cast<uint32_t>(end));
+    }
+
+    // Terms are read at random
+    madvise(const_cast<char *>(data_), length_, MADV_RANDOM);
+    return true;
+}
+
+bool Dictionary::SetDistribution(const string &spec, string *error) {
+    distribution_spec_ = spec;
+    if (spec == "uniform") {
+        distribution_ = UNIFORM;
+        return true;
+    }
+    if (spec.compare(0, 5, "zipf:") == 0) {
+        zipf_exponent_ = atof(spec.substr(5).c_str());
+        if (zipf_exponent_ <= 0) {
+            *error = "Zipf exponent must be positive: " + spec;
+            return false;
+        }
+        distribution_ = ZIPF;
+        double n = static_cast<double>(size_ > 0 ? size_ : 1);
+        zipf_h_integral_x1_ = ZipfHIntegral(1.5) - 1.0;
+        zipf_h_integral_n_ = ZipfHIntegral(n + 0.5);
+        zipf_s_ = 2.0 - ZipfHIntegralInverse(ZipfHIntegral(2.5) - ZipfH(2.0));
+        return true;
+    }
+    if (spec.compare(0, 8, "hotspot:") == 0) {
+        size_t colon = spec.find(':', 8);
+        if (colon == string::npos) {
+            *error = "hotspot needs x:y: " + spec;
+            return false;
+        }
+        double hot_percent = atof(spec.substr(8, colon - 8).c_str());
+        double draw_percent = atof(spec.substr(colon + 1).c_str());
+        if (hot_percent <= 0 || hot_percent >= 100 || draw_percent < 0 || draw_percent > 100) {
+            *error = "hotspot x must be in (0, 100) and y in [0, 100]: " + spec;
+            return false;
+        }
+        distribution_ = HOTSPOT;
+        hot_count_ = static_cast<size_t>(ceil(size_ * hot_percent / 100.0));
+        if (hot_count_ < 1) hot_count_ = 1;
+        if (hot_count_ > size_) hot_count_ = size_;
+        hot_ratio_ = draw_percent / 100.0;
+        return true;
+    }
+    *error = "unknown distribution " + spec;
+    return false;
+}
+
+string Dictionary::DistributionName() const {
+    return distribution_spec_;
+}
+
+size_t Dictionary::Size() const {
+    return size_;
+}
+
+const char *Dictionary::Term(size_t index, size_t *length) const {
+    size_t start = Offset(index);
+    size_t end = Offset(index + 1) - 1;
+    // Drop the carriage return of CRLF files
+    if (end > start && data_[end - 1] == '\r') end--;
+    *length = end - start;
+    return data_ + start;
+}
+
+void Dictionary::AppendTerm(Random *random, string *out) const {
+    size_t length;
+    const char *term = Term(Draw(random), &length);
+    out->append(term, length);
+}
+
+size_t Dictionary::Offset(size_t index) const {
+    return offsets32_.empty() ? static_cast<size_t>(offsets64_[index]) : offsets32_[index];
+}
+
+size_t Dictionary::Draw(Random *random) const {
+    switch (distribution_) {
+        case ZIPF:
+            return DrawZipf(random);
+        case HOTSPOT:
+            if (hot_count_ == size_ || random->NextDouble() < hot_ratio_) return random->Uniform(hot_count_);
+            return hot_count_ + random->Uniform(size_ - hot_count_);
+        default:
+            return random->Uniform(size_);
+    }
+}
+
+// Rank 1 to size_ in expected O(1) without a table, returned as an index from 0
+size_t Dictionary::DrawZipf(Random *random) const {
+    while (true) {
+        double u = zipf_h_integral_n_ + random->NextDouble() * (zipf_h_integral_x1_ - zipf_h_integral_n_);
+        double x = ZipfHIntegralInverse(u);
+        double k = floor(x + 0.5);
+        if (k < 1) {
+            k = 1;
+        } else if (k > size_) {
+            k = static_cast<double>(size_);
+        }
+        if (k - x <= zipf_s_ || u >= ZipfHIntegral(k + 0.5) - ZipfH(k)) {
+            return static_cast<size_t>(k) - 1;
+        }
+    }
+}
+
+double Dictionary::ZipfH(double x) const {
+    return exp(-zipf_exponent_ * log(x));
+}
+
+double Dictionary::ZipfHIntegral(double x) const {
+    double log_x = log(x);
+    return Helper2((1.0 - zipf_exponent_) * log_x) * log_x;
+}
+
+double Dictionary::ZipfHIntegralInverse(double x) const {
+    double t = x * (1.0 - zipf_exponent_);
+    if (t < -1.0) t = -1.0;
+    return exp(Helper1(t) * x);
+}
@@ -0,0 +1,79 @@
+//
+// Memory-mapped dictionary of terms with a skewed selection
+//
+
+#ifndef ESPERF_DICTIONARY_H
+#define ESPERF_DICTIONARY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Random.h"
+
+using namespace std;
+
+class Dictionary {
+public:
+    Dictionary() = default;
+
+    Dictionary(const Dictionary &) = delete;
+
+    Dictionary &operator=(const Dictionary &) = delete;
+
+    ~Dictionary();
+
+    // Map the newline delimited file and index the start of every line
+    bool Load(const string &filename, string *error);
+
+    // uniform, zipf:s or hotspot:x:y where x% of the terms receive y% of the draws
+    bool SetDistribution(const string &spec, string *error);
+
+    string DistributionName() const;
+
+    size_t Size() const;
+
+    // Term at the index, lines of the file in order
+    const char *Term(size_t index, size_t *length) const;
+
+    // Append a term drawn by the distribution, the earlier lines are the hotter ones
+    void AppendTerm(Random *random, string *out) const;
+
+private:
+    enum Distribution { UNIFORM, ZIPF, HOTSPOT };
+
+    const char *data_ = nullptr;
+    size_t length_ = 0;
+    size_t size_ = 0;
+
+    // Start of every line and the end of the last one, 32 bit unless the file is 4GB or larger
+    vector<uint32_t> offsets32_;
+    vector<uint64_t> offsets64_;
+
+    Distribution distribution_ = UNIFORM;
+    string distribution_spec_ = "uniform";
+
+    // Zipf distribution by rejection-inversion sampling (Hormann and Derflinger)
+    double zipf_exponent_ = 1.0;
+    double zipf_h_integral_x1_ = 0.0;
+    double zipf_h_integral_n_ = 0.0;
+    double zipf_s_ = 0.0;
+
+    // Hot spot of the first hot_count_ terms receiving hot_ratio_ of the draws
+    size_t hot_count_ = 0;
+    double hot_ratio_ = 0.0;
+
+    size_t Offset(size_t index) const;
+
+    size_t Draw(Random *random) const;
+
+    size_t DrawZipf(Random *random) const;
+
+    double ZipfH(double x) const;
+
+    double ZipfHIntegral(double x) const;
+
+    double ZipfHIntegralInverse(double x) const;
+};
+
+#endif //ESPERF_DICTIONARY_H
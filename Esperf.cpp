@@ -3,28 +3,78 @@
 //
 
 #include "Esperf.h"
+#include "Coordinator.h"
+#include "Exporter.h"
 
-void Esperf::Run()
+int Esperf::Run()
 {
+    Coordinator coordinator(options_, &mtx_for_cout_);
+    if (!options_->agents_.empty() && !coordinator.Setup()) return EXIT_FAILURE;
+
     Stats stats(options_, &mtx_for_cout_);
 
+    // Scraped while the run goes on, and until the results are printed
+    Exporter exporter(options_, &stats);
+    string error;
+    if (options_->metrics_port_ > 0 && !exporter.Start(options_->metrics_host_, options_->metrics_port_, &error)) {
+        cout << "Error: " << error << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (options_->report_.IsOpen()) {
+        Record record("options");
+        options_->Export(&record);
+        options_->report_.Write(record);
+    }
+
+    if (options_->agents_.empty()) {
+        RunWorkers(&stats);
+    } else {
+        // The agents run the workers, and the timer shows their merged counters
+        stats.SetCoordinator(&coordinator);
+        Profile profile(options_->stages_, options_->num_threads_, options_->request_rate_);
+        coordinator.Start();
+        thread th_timer(&Timer::Start, Timer(&stats, options_, &profile, nullptr));
+        coordinator.WaitUntilFinished();
+        stats.Finish();
+        th_timer.join();
+    }
+    options_->Print();
+    stats.ShowResult();
+    return stats.CheckBaseline() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void Esperf::RunWorkers(Stats *stats)
+{
+    Balancer balancer(options_->nodes_, options_->balance_policy_);
+    Profile profile(options_->stages_, options_->num_threads_, options_->request_rate_);
+    // Holds the level of the first probe before the workers start
+    Search search(options_, stats, &profile);
+
+    // The log is read ahead while the workers send it, on a timeline from now
+    if (options_->replay_.IsOpen()) options_->replay_.Start(chrono::steady_clock::now());
+    options_->logger_.Start();
+
     // Workers
     thread *thWorker;
     thWorker = new thread[options_->num_threads_];
     for (int i = 0; i < options_->num_threads_; i++) {
-        thWorker[i] = thread(&Worker::Run, Worker(&stats, options_, &mtx_for_cout_));
+        thWorker[i] = thread(&Worker::Run, Worker(stats, options_, &balancer, &profile, &mtx_for_cout_, i));
+        stats->AddWorkerThread(&thWorker[i]);
     }
 
     // create threads
-    thread th_timer(&Timer::Start, Timer(&stats, options_));
+    thread th_timer(&Timer::Start, Timer(stats, options_, &profile, &search));
 
     // run threads
     for (int i = 0; i < options_->num_threads_; i++) {
         thWorker[i].join();
     }
+    delete[] thWorker;
+    options_->replay_.Stop();
+    options_->logger_.Stop();
+    stats->Finish();
     th_timer.join();
-    options_->Print();
-    stats.ShowResult();
 }
 
-Esperf::Esperf(Options *options) : options_(options) {}
\ No newline at end of file
+Esperf::Esperf(Options *options) : options_(options) {}
@@ -17,7 +17,10 @@ using namespace std;
 class Esperf {
 public:
     Esperf(Options *options);
-    void Run();
+    // Return EXIT_FAILURE on a regression from the baseline
+    int Run();
+    // Run the workers and the timer until the workers return
+    void RunWorkers(Stats *stats);
 private:
     Options *options_;
     mutex mtx_for_cout_;
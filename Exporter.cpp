@@ -0,0 +1,243 @@
+//
+// HTTP endpoint of the live counters in the Prometheus text format
+//
+
+#include <csignal>
+#include <iomanip>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Exporter.h"
+#include "Channel.h"
+
+// Upper bounds in seconds of the latency buckets, the HDR histogram itself has thousands of them
+static const double BUCKETS[] = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0,
+                                 10.0, 30.0, 60.0};
+static const char *BUCKET_LABELS[] = {"0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25",
+                                      "0.5", "1", "2.5", "5", "10", "30", "60"};
+// msec to wait for a scrape or the stop, and for the request of a scrape
+static const int POLL_TIMEOUT_MSEC = 100;
+static const int REQUEST_TIMEOUT_MSEC = 1000;
+static const string CONTENT_TYPE = "text/plain; version=0.0.4";
+
+Exporter::Exporter(Options *options, Stats *stats) : options_(options), stats_(stats) {}
+
+Exporter::~Exporter() {
+    Stop();
+}
+
+bool Exporter::Start(const string &host, const u_int port, string *error) {
+    // A scraper going away is noticed from the failed send
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd_ = Channel::Listen(host, port, 16, error);
+    if (listen_fd_ < 0) return false;
+    server_ = thread(&Exporter::Serve, this);
+    return true;
+}
+
+void Exporter::Stop() {
+    stopped_ = true;
+    if (server_.joinable()) server_.join();
+    if (listen_fd_ >= 0) close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+// Scrapes are answered one at a time, they come seconds apart
+void Exporter::Serve() {
+    while (!stopped_) {
+        pollfd fd = {listen_fd_, POLLIN, 0};
+        if (poll(&fd, 1, POLL_TIMEOUT_MSEC) <= 0 || !(fd.revents & POLLIN)) continue;
+        int client = accept(listen_fd_, nullptr, nullptr);
+        if (client < 0) continue;
+        Respond(client);
+        close(client);
+    }
+}
+
+void Exporter::Respond(const int fd) const {
+    // Only the request line matters, the rest of the headers are read up to the blank line
+    string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == string::npos && request.size() < sizeof(buf) * 8) {
+        pollfd readable = {fd, POLLIN, 0};
+        if (poll(&readable, 1, REQUEST_TIMEOUT_MSEC) <= 0) return;
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    string status = "200 OK";
+    string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+        Render(&body);
+    } else {
+        status = "404 Not Found";
+        body = "Not Found\n";
+    }
+    string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + CONTENT_TYPE + "\r\nContent-Length: " +
+                      to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    for (size_t sent = 0; sent < response.size();) {
+        ssize_t n = send(fd, response.data() + sent, response.size() - sent, 0);
+        if (n <= 0) return;
+        sent += static_cast<size_t>(n);
+    }
+}
+
+// Counters since the start of the run, taken without a lock on the workers, the same as the progress
+void Exporter::Render(string *out) const {
+    Metrics metrics;
+    stats_->Snapshot(&metrics);
+    double elapsed_sec = chrono::duration<double>(chrono::steady_clock::now() - stats_->ClockStart()).count();
+
+    stringstream msg;
+    msg << fixed << setprecision(6);
+    RenderFamily(&msg, "esperf_requests_total", "counter", "Requests completed by their result.");
+    RenderRequests(&msg, "esperf_requests_total", "", metrics.success, metrics.error_curl, metrics.error_http,
+                   metrics.error_partial);
+
+    // The latency the progress shows, from the intended send time in the open-loop mode
+    RenderFamily(&msg, "esperf_request_duration_seconds", "histogram", "Transfer time of the successful requests.");
+    RenderHistogram(&msg, "esperf_request_duration_seconds", "", metrics.transfer, metrics.time_transfer);
+    if (options_->IsOpenLoop()) {
+        RenderFamily(&msg, "esperf_intended_duration_seconds", "histogram",
+                     "Latency of the successful requests from their intended send time.");
+        RenderHistogram(&msg, "esperf_intended_duration_seconds", "", metrics.response, metrics.time_response);
+        RenderFamily(&msg, "esperf_behind_schedule_total", "counter", "Requests sent behind the schedule.");
+        msg << "esperf_behind_schedule_total " << metrics.lag.Count() << "\n";
+    }
+    // Every attempt by its status or error, to tell the cluster pushing back from requests it cannot serve
+    RenderFamily(&msg, "esperf_responses_total", "counter", "Attempts answered by their HTTP status.");
+    for (int i = 0; i < STATUS_CODES; i++) {
+        if (metrics.statuses[i] == 0) continue;
+        msg << "esperf_responses_total{code=\"" << i << "\"} " << metrics.statuses[i] << "\n";
+    }
+    RenderFamily(&msg, "esperf_curl_errors_total", "counter", "Attempts failed by their curl error.");
+    for (int i = 0; i < CURL_CODES; i++) {
+        if (metrics.curl_errors[i] == 0) continue;
+        msg << "esperf_curl_errors_total{code=\"" << i << "\"} " << metrics.curl_errors[i] << "\n";
+    }
+    RenderFamily(&msg, "esperf_rejections_total", "counter", "Rejected executions reported by the responses.");
+    msg << "esperf_rejections_total " << metrics.rejections << "\n";
+    if (options_->retry_.IsEnabled()) {
+        RenderFamily(&msg, "esperf_retries_total", "counter", "Retries by whether the budget let them be sent.");
+        msg << "esperf_retries_total{result=\"sent\"} " << metrics.retries << "\n"
+            << "esperf_retries_total{result=\"denied\"} " << metrics.retries_denied << "\n";
+        RenderFamily(&msg, "esperf_retried_duration_seconds", "histogram",
+                     "Latency of the requests successful after a retry from their first intended send time.");
+        RenderHistogram(&msg, "esperf_retried_duration_seconds", "", metrics.retried, metrics.time_retried);
+    }
+
+    RenderFamily(&msg, "esperf_took_seconds", "histogram", "Server side took of the responses which have it.");
+    RenderHistogram(&msg, "esperf_took_seconds", "", metrics.took, metrics.time_took);
+
+    RenderFamily(&msg, "esperf_upload_bytes_total", "counter", "Bytes sent on the wire.");
+    msg << "esperf_upload_bytes_total " << metrics.size_upload << "\n";
+    RenderFamily(&msg, "esperf_download_bytes_total", "counter", "Bytes received on the wire.");
+    msg << "esperf_download_bytes_total " << metrics.size_download << "\n";
+    RenderFamily(&msg, "esperf_upload_decoded_bytes_total", "counter", "Bytes sent before the compression.");
+    msg << "esperf_upload_decoded_bytes_total " << metrics.size_upload_decoded << "\n";
+    RenderFamily(&msg, "esperf_download_decoded_bytes_total", "counter", "Bytes received after the decoding.");
+    msg << "esperf_download_decoded_bytes_total " << metrics.size_download_decoded << "\n";
+    if (options_->bulk_docs_ > 0) {
+        RenderFamily(&msg, "esperf_documents_total", "counter", "Documents sent in the bulk requests.");
+        msg << "esperf_documents_total " << metrics.docs << "\n";
+    }
+    RenderFamily(&msg, "esperf_connections_total", "counter", "Connections opened.");
+    msg << "esperf_connections_total " << metrics.connects << "\n";
+    if (!metrics.pages.empty()) {
+        RenderFamily(&msg, "esperf_sessions_total", "counter", "Sessions gone through by their result.");
+        msg << "esperf_sessions_total{result=\"complete\"} " << metrics.sessions << "\n"
+            << "esperf_sessions_total{result=\"failed\"} " << metrics.sessions_failed << "\n";
+    }
+
+    // Broken out by the queries of the workload and by the nodes, when there is more than one
+    vector<string> queries;
+    for (size_t i = 0; i < options_->workload_.Size(); i++) queries.push_back(options_->workload_.At(i).label);
+    for (auto group : {make_pair(string("query"), make_pair(&metrics.queries, &queries)),
+                       make_pair(string("node"), make_pair(&metrics.nodes, &options_->nodes_))}) {
+        const vector<GroupMetrics> &groups = *group.second.first;
+        const vector<string> &names = *group.second.second;
+        if (groups.empty()) continue;
+        string requests = "esperf_" + group.first + "_requests_total";
+        string duration = "esperf_" + group.first + "_duration_seconds";
+        RenderFamily(&msg, requests, "counter", "Requests completed by the " + group.first + " and their result.");
+        for (size_t i = 0; i < groups.size() && i < names.size(); i++) {
+            RenderRequests(&msg, requests, group.first + "=\"" + Escape(names[i]) + "\"", groups[i].success,
+                           groups[i].error_curl, groups[i].error_http, groups[i].error_partial);
+        }
+        RenderFamily(&msg, duration, "histogram", "Latency of the successful requests by the " + group.first + ".");
+        for (size_t i = 0; i < groups.size() && i < names.size(); i++) {
+            RenderHistogram(&msg, duration, group.first + "=\"" + Escape(names[i]) + "\"", groups[i].latency,
+                            groups[i].time_latency);
+        }
+    }
+
+    // Load of the client itself, to tell it from that of the cluster
+    RenderFamily(&msg, "esperf_cpu_seconds_total", "counter", "User and system CPU time of esperf.");
+    msg << "esperf_cpu_seconds_total " << metrics.cpu / 1000000.0 << "\n";
+    RenderFamily(&msg, "esperf_context_switches_total", "counter", "Context switches of esperf by their kind.");
+    msg << "esperf_context_switches_total{kind=\"voluntary\"} " << metrics.switches_voluntary << "\n"
+        << "esperf_context_switches_total{kind=\"involuntary\"} " << metrics.switches_involuntary << "\n";
+    RenderFamily(&msg, "esperf_elapsed_seconds", "gauge", "Seconds since the start of the run.");
+    msg << "esperf_elapsed_seconds " << elapsed_sec << "\n";
+    *out = msg.str();
+}
+
+void Exporter::RenderFamily(stringstream *out, const string &name, const string &type, const string &help) {
+    *out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+void Exporter::RenderRequests(stringstream *out, const string &name, const string &labels, const u_long success,
+                              const u_long error_curl, const u_long error_http, const u_long error_partial) {
+    const char *results[] = {"success", "error_curl", "error_http", "error_partial"};
+    const u_long counts[] = {success, error_curl, error_http, error_partial};
+    for (int i = 0; i < 4; i++) {
+        *out << name << "{" << labels << (labels.empty() ? "" : ",") << "result=\"" << results[i] << "\"} "
+             << counts[i] << "\n";
+    }
+}
+
+void Exporter::RenderHistogram(stringstream *out, const string &name, const string &labels,
+                               const Histogram &histogram, const u_long sum_usec) {
+    string separator = labels.empty() ? "" : ",";
+    // A slot of the histogram falls in the first bucket which holds its highest value
+    size_t bucket = 0;
+    uint64_t cumulative = 0;
+    const size_t bucket_count = sizeof(BUCKETS) / sizeof(BUCKETS[0]);
+    for (int i = 0; i < Histogram::COUNTS_LEN && bucket < bucket_count; i++) {
+        uint64_t count = histogram.CountAt(i);
+        if (count == 0) continue;
+        while (bucket < bucket_count && Histogram::HighestEquivalentValue(i) > BUCKETS[bucket] * 1000000) {
+            *out << name << "_bucket{" << labels << separator << "le=\"" << BUCKET_LABELS[bucket] << "\"} "
+                 << cumulative << "\n";
+            bucket++;
+        }
+        cumulative += count;
+    }
+    for (; bucket < bucket_count; bucket++) {
+        *out << name << "_bucket{" << labels << separator << "le=\"" << BUCKET_LABELS[bucket] << "\"} "
+             << cumulative << "\n";
+    }
+    *out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << histogram.Count() << "\n";
+    string braces = labels.empty() ? "" : "{" + labels + "}";
+    *out << name << "_sum" << braces << " " << sum_usec / 1000000.0 << "\n";
+    *out << name << "_count" << braces << " " << histogram.Count() << "\n";
+}
+
+// Backslashes, quotes and new lines of a label value
+string Exporter::Escape(const string &value) {
+    string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
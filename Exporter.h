@@ -0,0 +1,59 @@
+//
+// HTTP endpoint of the live counters in the Prometheus text format
+//
+
+#ifndef ESPERF_EXPORTER_H
+#define ESPERF_EXPORTER_H
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Options.h"
+#include "Stats.h"
+
+using namespace std;
+
+class Exporter {
+public:
+    Exporter(Options *options, Stats *stats);
+
+    ~Exporter();
+
+    // Listen on host:port and serve in a thread of its own, false if the port cannot be listened on
+    bool Start(const string &host, const u_int port, string *error);
+
+    void Stop();
+
+    // The exposition of the counters so far
+    void Render(string *out) const;
+
+private:
+    Options *options_;
+    Stats *stats_;
+    int listen_fd_ = -1;
+    thread server_;
+    atomic_bool stopped_{false};
+
+    void Serve();
+
+    // Answer one scrape and close the connection
+    void Respond(const int fd) const;
+
+    // HELP and TYPE lines, which come once before the samples of a metric
+    static void RenderFamily(stringstream *out, const string &name, const string &type, const string &help);
+
+    // Requests by their result, with the labels of a query or a node if any
+    static void RenderRequests(stringstream *out, const string &name, const string &labels, const u_long success,
+                               const u_long error_curl, const u_long error_http, const u_long error_partial);
+
+    // Cumulative buckets, sum and count of a latency histogram in seconds
+    static void RenderHistogram(stringstream *out, const string &name, const string &labels,
+                                const Histogram &histogram, const u_long sum_usec);
+
+    static string Escape(const string &value);
+};
+
+#endif //ESPERF_EXPORTER_H
@@ -0,0 +1,60 @@
+//
+// gzip compression of request bodies
+//
+
+#include <cstring>
+
+#include "Gzip.h"
+
+// 15 bits of window plus 16 for the gzip header and trailer
+static const int GZIP_WINDOW_BITS = 15 + 16;
+static const int MEMORY_LEVEL = 8;
+static const size_t CHUNK_SIZE = 16384;
+
+Gzip::Gzip() {
+    memset(&stream_, 0, sizeof(stream_));
+    ready_ = deflateInit2(&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS, MEMORY_LEVEL,
+                          Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+Gzip::~Gzip() {
+    if (ready_) deflateEnd(&stream_);
+}
+
+bool Gzip::IsReady() const {
+    return ready_;
+}
+
+void Gzip::Compress(const char *data, size_t length, string *out) {
+    Reset();
+    Deflate(data, length, Z_FINISH, out);
+}
+
+void Gzip::Reset() {
+    if (ready_) deflateReset(&stream_);
+}
+
+void Gzip::Append(const char *data, size_t length, string *out) {
+    Deflate(data, length, Z_NO_FLUSH, out);
+}
+
+void Gzip::Finish(string *out) {
+    Deflate(nullptr, 0, Z_FINISH, out);
+}
+
+// Run deflate until the input is consumed, and on Z_FINISH until the trailer is written
+void Gzip::Deflate(const char *data, size_t length, int flush, string *out) {
+    if (!ready_) return;
+    stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream_.avail_in = static_cast<uInt>(length);
+    while (true) {
+        size_t offset = out->size();
+        out->resize(offset + CHUNK_SIZE);
+        stream_.next_out = reinterpret_cast<Bytef *>(&(*out)[offset]);
+        stream_.avail_out = static_cast<uInt>(CHUNK_SIZE);
+        int result = deflate(&stream_, flush);
+        out->resize(offset + CHUNK_SIZE - stream_.avail_out);
+        if (result == Z_STREAM_END || result == Z_STREAM_ERROR) break;
+        if (stream_.avail_in == 0 && stream_.avail_out > 0) break;
+    }
+}
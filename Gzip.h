@@ -0,0 +1,44 @@
+//
+// gzip compression of request bodies
+//
+
+#ifndef ESPERF_GZIP_H
+#define ESPERF_GZIP_H
+
+#include <string>
+#include <zlib.h>
+
+using namespace std;
+
+// A deflate stream in the gzip format, reset and reused for every body to save the allocation
+class Gzip {
+public:
+    Gzip();
+
+    Gzip(const Gzip &) = delete;
+
+    Gzip &operator=(const Gzip &) = delete;
+
+    ~Gzip();
+
+    // zlib could set the stream up, nothing is compressed otherwise
+    bool IsReady() const;
+
+    // Compress a whole body, appended to out
+    void Compress(const char *data, size_t length, string *out);
+
+    // Start a body to compress in pieces with Append and Finish
+    void Reset();
+
+    void Append(const char *data, size_t length, string *out);
+
+    void Finish(string *out);
+
+private:
+    z_stream stream_;
+    bool ready_;
+
+    void Deflate(const char *data, size_t length, int flush, string *out);
+};
+
+#endif //ESPERF_GZIP_H
@@ -0,0 +1,98 @@
+//
+// High dynamic range histogram of latencies in microseconds
+//
+
+#include <cmath>
+
+#include "Histogram.h"
+
+static const uint64_t SUB_BUCKET_MASK = static_cast<uint64_t>(Histogram::SUB_BUCKET_COUNT - 1);
+
+Histogram::Histogram() : counts_(COUNTS_LEN, 0) {}
+
+int Histogram::CountsIndex(uint64_t value) {
+    int pow2ceiling = 64 - __builtin_clzll(value | SUB_BUCKET_MASK);
+    int bucket_index = pow2ceiling - (SUB_BUCKET_HALF_COUNT_MAGNITUDE + 1);
+    int sub_bucket_index = static_cast<int>(value >> bucket_index);
+    int index = ((bucket_index + 1) << SUB_BUCKET_HALF_COUNT_MAGNITUDE) + (sub_bucket_index - SUB_BUCKET_HALF_COUNT);
+    // Values beyond the range are kept in the last slot
+    return index < COUNTS_LEN ? index : COUNTS_LEN - 1;
+}
+
+uint64_t Histogram::HighestEquivalentValue(int index) {
+    int bucket_index = (index >> SUB_BUCKET_HALF_COUNT_MAGNITUDE) - 1;
+    int sub_bucket_index = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+    if (bucket_index < 0) {
+        sub_bucket_index -= SUB_BUCKET_HALF_COUNT;
+        bucket_index = 0;
+    }
+    return (static_cast<uint64_t>(sub_bucket_index) << bucket_index) + (static_cast<uint64_t>(1) << bucket_index) - 1;
+}
+
+void Histogram::Record(uint64_t value) {
+    counts_[CountsIndex(value)]++;
+    total_count_++;
+}
+
+void Histogram::Add(const Histogram &other) {
+    for (int i = 0; i < COUNTS_LEN; i++) counts_[i] += other.counts_[i];
+    total_count_ += other.total_count_;
+}
+
+// Counts of other must have been taken earlier from the same source
+void Histogram::Subtract(const Histogram &other) {
+    for (int i = 0; i < COUNTS_LEN; i++) counts_[i] -= other.counts_[i];
+    total_count_ -= other.total_count_;
+}
+
+void Histogram::Reset() {
+    fill(counts_.begin(), counts_.end(), 0);
+    total_count_ = 0;
+}
+
+uint64_t Histogram::Count() const {
+    return total_count_;
+}
+
+uint64_t Histogram::ValueAtPercentile(double percentile) const {
+    if (total_count_ == 0) return 0;
+    uint64_t count_at_percentile = static_cast<uint64_t>(ceil(percentile / 100.0 * total_count_));
+    if (count_at_percentile < 1) count_at_percentile = 1;
+
+    uint64_t total = 0;
+    for (int i = 0; i < COUNTS_LEN; i++) {
+        total += counts_[i];
+        if (total >= count_at_percentile) return HighestEquivalentValue(i);
+    }
+    return Max();
+}
+
+uint64_t Histogram::Max() const {
+    for (int i = COUNTS_LEN - 1; i >= 0; i--) {
+        if (counts_[i] > 0) return HighestEquivalentValue(i);
+    }
+    return 0;
+}
+
+uint64_t Histogram::CountAt(int index) const {
+    return counts_[index];
+}
+
+void Histogram::AddCount(int index, uint64_t count) {
+    counts_[index] += count;
+    total_count_ += count;
+}
+
+AtomicHistogram::AtomicHistogram() : counts_(new atomic<uint64_t>[Histogram::COUNTS_LEN]) {
+    for (int i = 0; i < Histogram::COUNTS_LEN; i++) counts_[i].store(0, memory_order_relaxed);
+}
+
+void AtomicHistogram::AddTo(Histogram *histogram) const {
+    uint64_t total = 0;
+    for (int i = 0; i < Histogram::COUNTS_LEN; i++) {
+        uint64_t count = counts_[i].load(memory_order_relaxed);
+        histogram->counts_[i] += count;
+        total += count;
+    }
+    histogram->total_count_ += total;
+}
@@ -0,0 +1,75 @@
+//
+// High dynamic range histogram of latencies in microseconds
+//
+
+#ifndef ESPERF_HISTOGRAM_H
+#define ESPERF_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// Values from 1 usec up to about 1 hour are kept with 2 significant digits
+class Histogram {
+public:
+    static const int SUB_BUCKET_HALF_COUNT_MAGNITUDE = 7;
+    static const int SUB_BUCKET_HALF_COUNT = 1 << SUB_BUCKET_HALF_COUNT_MAGNITUDE;
+    static const int SUB_BUCKET_COUNT = SUB_BUCKET_HALF_COUNT * 2;
+    static const int BUCKET_COUNT = 25;
+    static const int COUNTS_LEN = (BUCKET_COUNT + 1) * SUB_BUCKET_HALF_COUNT;
+
+    Histogram();
+
+    static int CountsIndex(uint64_t value);
+
+    // Largest value which falls in the same slot as the index
+    static uint64_t HighestEquivalentValue(int index);
+
+    void Record(uint64_t value);
+
+    void Add(const Histogram &other);
+
+    void Subtract(const Histogram &other);
+
+    void Reset();
+
+    uint64_t Count() const;
+
+    uint64_t ValueAtPercentile(double percentile) const;
+
+    uint64_t Max() const;
+
+    uint64_t CountAt(int index) const;
+
+    void AddCount(int index, uint64_t count);
+
+private:
+    friend class AtomicHistogram;
+
+    vector<uint64_t> counts_;
+    uint64_t total_count_ = 0;
+};
+
+// Histogram written by a single thread and read by others without locks
+class AtomicHistogram {
+public:
+    AtomicHistogram();
+
+    // Only the owner thread may record, so a relaxed load and store is enough
+    void Record(uint64_t value) {
+        atomic<uint64_t> &count = counts_[Histogram::CountsIndex(value)];
+        count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    // Add the current counts to the histogram
+    void AddTo(Histogram *histogram) const;
+
+private:
+    unique_ptr<atomic<uint64_t>[]> counts_;
+};
+
+#endif //ESPERF_HISTOGRAM_H
@@ -0,0 +1,191 @@
+//
+// Minimal JSON reading and writing for workload and result files
+//
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Json.h"
+
+bool Json::ParseObject(const string &text, map<string, JsonValue> *members, string *error) {
+    size_t pos = 0;
+    SkipSpaces(text, &pos);
+    if (pos >= text.size() || text[pos] != '{') {
+        *error = "object expected";
+        return false;
+    }
+    pos++;
+    SkipSpaces(text, &pos);
+    if (pos < text.size() && text[pos] == '}') return true;
+
+    while (pos < text.size()) {
+        string name;
+        SkipSpaces(text, &pos);
+        if (!ParseString(text, &pos, &name)) {
+            *error = "member name expected at " + to_string(pos);
+            return false;
+        }
+        SkipSpaces(text, &pos);
+        if (pos >= text.size() || text[pos] != ':') {
+            *error = "':' expected at " + to_string(pos);
+            return false;
+        }
+        pos++;
+        SkipSpaces(text, &pos);
+        JsonValue value;
+        if (!ParseValue(text, &pos, &value)) {
+            *error = "invalid value of \"" + name + "\"";
+            return false;
+        }
+        (*members)[name] = value;
+        SkipSpaces(text, &pos);
+        if (pos < text.size() && text[pos] == ',') {
+            pos++;
+            continue;
+        }
+        if (pos < text.size() && text[pos] == '}') return true;
+        *error = "',' or '}' expected at " + to_string(pos);
+        return false;
+    }
+    *error = "unterminated object";
+    return false;
+}
+
+string Json::Quote(const string &in) {
+    string out = "\"";
+    for (unsigned char c : in) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    out += "\"";
+    return out;
+}
+
+void Json::SkipSpaces(const string &text, size_t *pos) {
+    while (*pos < text.size() && isspace(static_cast<unsigned char>(text[*pos]))) (*pos)++;
+}
+
+bool Json::ParseString(const string &text, size_t *pos, string *out) {
+    if (*pos >= text.size() || text[*pos] != '"') return false;
+    (*pos)++;
+    while (*pos < text.size()) {
+        char c = text[(*pos)++];
+        if (c == '"') return true;
+        if (c != '\\') {
+            *out += c;
+            continue;
+        }
+        if (*pos >= text.size()) return false;
+        c = text[(*pos)++];
+        switch (c) {
+            case 'b': *out += '\b'; break;
+            case 'f': *out += '\f'; break;
+            case 'n': *out += '\n'; break;
+            case 'r': *out += '\r'; break;
+            case 't': *out += '\t'; break;
+            case 'u': {
+                if (*pos + 4 > text.size()) return false;
+                unsigned int code_point = static_cast<unsigned int>(strtoul(text.substr(*pos, 4).c_str(), NULL, 16));
+                *pos += 4;
+                // Combine a surrogate pair
+                if (code_point >= 0xd800 && code_point < 0xdc00 && *pos + 6 <= text.size() &&
+                    text.compare(*pos, 2, "\\u") == 0) {
+                    unsigned int low = static_cast<unsigned int>(strtoul(text.substr(*pos + 2, 4).c_str(), NULL, 16));
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                        *pos += 6;
+                    }
+                }
+                AppendUtf8(out, code_point);
+                break;
+            }
+            default:
+                *out += c;
+        }
+    }
+    return false;
+}
+
+bool Json::ParseValue(const string &text, size_t *pos, JsonValue *value) {
+    if (*pos >= text.size()) return false;
+    size_t start = *pos;
+    char c = text[*pos];
+
+    if (c == '"') {
+        value->type = JsonValue::STRING;
+        return ParseString(text, pos, &value->text);
+    }
+    if (c == '{' || c == '[') {
+        value->type = c == '{' ? JsonValue::OBJECT : JsonValue::ARRAY;
+        if (!SkipNested(text, pos)) return false;
+        value->text = text.substr(start, *pos - start);
+        return true;
+    }
+
+    // Literals and numbers run until a delimiter
+    while (*pos < text.size() && !strchr(",}] \t\r\n", text[*pos])) (*pos)++;
+    value->text = text.substr(start, *pos - start);
+    if (value->text == "true" || value->text == "false") {
+        value->type = JsonValue::BOOL;
+    } else if (value->text == "null") {
+        value->type = JsonValue::NIL;
+    } else {
+        char *end;
+        strtod(value->text.c_str(), &end);
+        if (value->text.empty() || *end != '\0') return false;
+        value->type = JsonValue::NUMBER;
+    }
+    return true;
+}
+
+// Skip an object or an array including the nested ones
+bool Json::SkipNested(const string &text, size_t *pos) {
+    int depth = 0;
+    while (*pos < text.size()) {
+        char c = text[*pos];
+        if (c == '"') {
+            string ignored;
+            if (!ParseString(text, pos, &ignored)) return false;
+            continue;
+        }
+        (*pos)++;
+        if (c == '{' || c == '[') depth++;
+        if (c == '}' || c == ']') {
+            if (--depth == 0) return true;
+        }
+    }
+    return false;
+}
+
+void Json::AppendUtf8(string *out, unsigned int code_point) {
+    if (code_point < 0x80) {
+        *out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        *out += static_cast<char>(0xc0 | (code_point >> 6));
+        *out += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else if (code_point < 0x10000) {
+        *out += static_cast<char>(0xe0 | (code_point >> 12));
+        *out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        *out += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else {
+        *out += static_cast<char>(0xf0 | (code_point >> 18));
+        *out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+        *out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        *out += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+}
@@ -0,0 +1,41 @@
+//
+// Minimal JSON reading and writing for workload and result files
+//
+
+#ifndef ESPERF_JSON_H
+#define ESPERF_JSON_H
+
+#include <map>
+#include <string>
+
+using namespace std;
+
+struct JsonValue {
+    enum Type { STRING, NUMBER, BOOL, NIL, OBJECT, ARRAY };
+
+    Type type = NIL;
+    // Unescaped text of a string, raw JSON text of the others
+    string text;
+};
+
+class Json {
+public:
+    // Parse a single JSON object into its members, nested objects and arrays are kept as raw text
+    static bool ParseObject(const string &text, map<string, JsonValue> *members, string *error);
+
+    // Quote and escape a string
+    static string Quote(const string &in);
+
+private:
+    static void SkipSpaces(const string &text, size_t *pos);
+
+    static bool ParseString(const string &text, size_t *pos, string *out);
+
+    static bool ParseValue(const string &text, size_t *pos, JsonValue *value);
+
+    static bool SkipNested(const string &text, size_t *pos);
+
+    static void AppendUtf8(string *out, unsigned int code_point);
+};
+
+#endif //ESPERF_JSON_H
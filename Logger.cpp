@@ -0,0 +1,180 @@
+//
+// Sampled requests written to a file off the hot path, handed over through a ring buffer for each worker
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+#include "Logger.h"
+#include "Json.h"
+
+// Entries each worker may have waiting for the writer, beyond which they are dropped rather than waited for
+static const u_long RING_SIZE = 1024;
+// Bytes of a URL kept in an entry without a reallocation
+static const size_t URL_SIZE = 2048;
+// msec the writer sleeps once the rings are empty
+static const int IDLE_MSEC = 20;
+
+static const char *REASONS[] = {"failed", "slow", "sampled"};
+
+Logger::~Logger() {
+    Stop();
+}
+
+bool Logger::ParseSampling(const string &spec, string *error) {
+    stringstream items(spec);
+    for (string item; getline(items, item, ',');) {
+        if (item.empty()) continue;
+        size_t equal = item.find('=');
+        if (equal == string::npos || equal == 0) {
+            *error = "log sampling must be name=value: " + item;
+            return false;
+        }
+        string name = item.substr(0, equal);
+        double value = atof(item.substr(equal + 1).c_str());
+        if (value < 0) {
+            *error = "log sampling must not be negative: " + item;
+            return false;
+        }
+        if (name == "every") {
+            every_ = static_cast<u_long>(value);
+        } else if (name == "errors") {
+            errors_ = value > 0;
+        } else if (name == "slow") {
+            slow_sec_ = value;
+        } else if (name == "capture") {
+            capture_ = static_cast<size_t>(value);
+        } else {
+            *error = "unknown log sampling: " + name;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Logger::Open(const string &filename, const u_int workers, string *error) {
+    out_.open(filename, ios::out | ios::trunc);
+    if (!out_) {
+        *error = "cannot open the log file " + filename;
+        return false;
+    }
+    for (u_int i = 0; i < workers; i++) {
+        rings_.push_back(unique_ptr<Ring>(new Ring()));
+        rings_.back()->entries.resize(RING_SIZE);
+        for (Entry &entry : rings_.back()->entries) {
+            entry.url.reserve(URL_SIZE);
+            entry.request.reserve(capture_);
+            entry.response.reserve(capture_);
+        }
+    }
+    return true;
+}
+
+bool Logger::IsOpen() const {
+    return out_.is_open();
+}
+
+void Logger::Start() {
+    if (IsOpen() && !writer_.joinable()) writer_ = thread(&Logger::Run, this);
+}
+
+void Logger::Stop() {
+    stopped_ = true;
+    if (writer_.joinable()) writer_.join();
+    if (!IsOpen()) return;
+    Drain();
+    out_.close();
+}
+
+bool Logger::Sample(u_long *count, const bool failed, const double latency, Reason *reason) const {
+    (*count)++;
+    if (failed && errors_) {
+        *reason = FAILED;
+    } else if (slow_sec_ > 0 && latency >= slow_sec_) {
+        *reason = SLOW;
+    } else if (every_ > 0 && *count % every_ == 0) {
+        *reason = SAMPLED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+Logger::Entry *Logger::Acquire(const u_int worker) {
+    Ring *ring = rings_[worker].get();
+    u_long head = ring->head.load(memory_order_relaxed);
+    if (head - ring->tail.load(memory_order_acquire) >= RING_SIZE) {
+        ring->dropped.store(ring->dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return nullptr;
+    }
+    return &ring->entries[head % RING_SIZE];
+}
+
+void Logger::Commit(const u_int worker) {
+    Ring *ring = rings_[worker].get();
+    ring->head.store(ring->head.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+size_t Logger::CaptureSize() const {
+    return capture_;
+}
+
+u_long Logger::Written() const {
+    return written_;
+}
+
+u_long Logger::Dropped() const {
+    u_long dropped = 0;
+    for (const auto &ring : rings_) dropped += ring->dropped.load(memory_order_relaxed);
+    return dropped;
+}
+
+void Logger::Run() {
+    while (!stopped_) {
+        if (!Drain()) this_thread::sleep_for(chrono::milliseconds(IDLE_MSEC));
+    }
+}
+
+bool Logger::Drain() {
+    string line;
+    bool any = false;
+    for (auto &ring : rings_) {
+        u_long tail = ring->tail.load(memory_order_relaxed);
+        u_long head = ring->head.load(memory_order_acquire);
+        if (tail < head) any = true;
+        for (; tail < head; tail++) {
+            Write(ring->entries[tail % RING_SIZE], &line);
+            out_ << line;
+            written_++;
+        }
+        // The worker may fill the entries again from here
+        ring->tail.store(tail, memory_order_release);
+    }
+    if (any) out_.flush();
+    return any;
+}
+
+// A line of JSON for each request
+void Logger::Write(const Entry &entry, string *line) const {
+    time_t seconds = static_cast<time_t>(entry.timestamp / 1000000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char date[32];
+    char zone[8];
+    strftime(date, sizeof(date), "%FT%T", &local);
+    strftime(zone, sizeof(zone), "%z", &local);
+    char millis[8];
+    snprintf(millis, sizeof(millis), ".%03d", static_cast<int>(entry.timestamp / 1000 % 1000));
+
+    stringstream out;
+    out << "{\"timestamp\":\"" << date << millis << zone << "\",\"thread\":" << entry.worker;
+    if (entry.label) out << ",\"query\":" << Json::Quote(*entry.label);
+    out << ",\"reason\":\"" << REASONS[entry.reason] << "\",\"method\":" << Json::Quote(entry.method)
+        << ",\"url\":" << Json::Quote(entry.url) << ",\"status\":" << entry.status << ",\"curl\":"
+        << entry.curl_code << ",\"retries\":" << entry.retries << ",\"latency\":" << entry.latency
+        << ",\"request\":" << Json::Quote(entry.request) << ",\"response\":" << Json::Quote(entry.response) << "}\n";
+    *line = out.str();
+}
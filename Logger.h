@@ -0,0 +1,109 @@
+//
+// Sampled requests written to a file off the hot path, handed over through a ring buffer for each worker
+//
+
+#ifndef ESPERF_LOGGER_H
+#define ESPERF_LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+using namespace std;
+
+class Logger {
+public:
+    // Why a request is logged, the first that applies
+    enum Reason { FAILED, SLOW, SAMPLED };
+
+    // A request as a worker hands it over, the writer thread formats it
+    struct Entry {
+        // usec since the epoch at the completion
+        int64_t timestamp = 0;
+        u_int worker = 0;
+        // Label of the query in the workload, null for a replayed request
+        const string *label = nullptr;
+        long status = 0;
+        int curl_code = 0;
+        u_int retries = 0;
+        double latency = 0.0;
+        Reason reason = SAMPLED;
+        string method;
+        string url;
+        // Body sent and response received, cut to the capture size
+        string request;
+        string response;
+    };
+
+    ~Logger();
+
+    // Comma separated name=value of every, errors, slow and capture, such as every=1000,slow=0.5
+    bool ParseSampling(const string &spec, string *error);
+
+    // Create the file and the rings of the workers, the strings of the entries are allocated once here
+    bool Open(const string &filename, const u_int workers, string *error);
+
+    bool IsOpen() const;
+
+    // Write the entries in a thread of its own until Stop
+    void Start();
+
+    // Write the entries left and close the file, once the workers have returned
+    void Stop();
+
+    // Whether a request is logged and why, count is the number of requests of the worker so far
+    bool Sample(u_long *count, const bool failed, const double latency, Reason *reason) const;
+
+    // Next free entry of the ring of the worker, null if the ring is full and the entry is dropped
+    Entry *Acquire(const u_int worker);
+
+    // Hand the entry acquired over to the writer thread
+    void Commit(const u_int worker);
+
+    // Bytes of the bodies kept
+    size_t CaptureSize() const;
+
+    u_long Written() const;
+
+    u_long Dropped() const;
+
+private:
+    // Written by a single worker and read by the writer thread, the positions grow without wrapping
+    struct Ring {
+        char padding_head[CACHE_LINE_SIZE];
+        atomic<u_long> head{0};
+        char padding_mid[CACHE_LINE_SIZE];
+        atomic<u_long> tail{0};
+        atomic<u_long> dropped{0};
+        vector<Entry> entries;
+        char padding_tail[CACHE_LINE_SIZE];
+    };
+
+    // 1 in every_ requests, the failed ones and those slower than slow_sec_, 0 for none
+    u_long every_ = 0;
+    bool errors_ = true;
+    double slow_sec_ = 0;
+    size_t capture_ = 512;
+
+    ofstream out_;
+    vector<unique_ptr<Ring>> rings_;
+    thread writer_;
+    atomic_bool stopped_{false};
+    u_long written_ = 0;
+
+    void Run();
+
+    // Write the entries committed so far, false if there were none
+    bool Drain();
+
+    void Write(const Entry &entry, string *line) const;
+};
+
+#endif //ESPERF_LOGGER_H
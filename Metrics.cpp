@@ -0,0 +1,318 @@
+//
+// Per-worker statistics slots and their merged snapshots
+//
+
+#include "Metrics.h"
+#include "Channel.h"
+
+// Pairs of index and count of the slots in use
+static void EncodeHistogram(const Histogram &histogram, string *out) {
+    uint64_t used = 0;
+    for (int i = 0; i < Histogram::COUNTS_LEN; i++) {
+        if (histogram.CountAt(i) > 0) used++;
+    }
+    Channel::PutNumber(out, used);
+    for (int i = 0; i < Histogram::COUNTS_LEN; i++) {
+        if (histogram.CountAt(i) == 0) continue;
+        Channel::PutNumber(out, static_cast<uint64_t>(i));
+        Channel::PutNumber(out, histogram.CountAt(i));
+    }
+}
+
+static bool DecodeHistogram(const string &in, size_t *pos, Histogram *histogram) {
+    uint64_t used;
+    if (!Channel::GetNumber(in, pos, &used)) return false;
+    for (uint64_t i = 0; i < used; i++) {
+        uint64_t index;
+        uint64_t count;
+        if (!Channel::GetNumber(in, pos, &index) || !Channel::GetNumber(in, pos, &count) ||
+            index >= static_cast<uint64_t>(Histogram::COUNTS_LEN)) {
+            return false;
+        }
+        histogram->AddCount(static_cast<int>(index), count);
+    }
+    return true;
+}
+
+// Pairs of index and count of the counters in use, the same as the histograms
+static void EncodeCounts(const u_long *counts, const int size, string *out) {
+    uint64_t used = 0;
+    for (int i = 0; i < size; i++) {
+        if (counts[i] > 0) used++;
+    }
+    Channel::PutNumber(out, used);
+    for (int i = 0; i < size; i++) {
+        if (counts[i] == 0) continue;
+        Channel::PutNumber(out, static_cast<uint64_t>(i));
+        Channel::PutNumber(out, counts[i]);
+    }
+}
+
+static bool DecodeCounts(const string &in, size_t *pos, u_long *counts, const int size) {
+    uint64_t used;
+    if (!Channel::GetNumber(in, pos, &used)) return false;
+    for (uint64_t i = 0; i < used; i++) {
+        uint64_t index;
+        uint64_t count;
+        if (!Channel::GetNumber(in, pos, &index) || !Channel::GetNumber(in, pos, &count) ||
+            index >= static_cast<uint64_t>(size)) {
+            return false;
+        }
+        counts[index] += static_cast<u_long>(count);
+    }
+    return true;
+}
+
+static bool DecodeNumber(const string &in, size_t *pos, u_long *value) {
+    uint64_t number;
+    if (!Channel::GetNumber(in, pos, &number)) return false;
+    *value += static_cast<u_long>(number);
+    return true;
+}
+
+void Metrics::Add(const MetricsSlot &slot) {
+    success += slot.success.load(memory_order_relaxed);
+    error_curl += slot.error_curl.load(memory_order_relaxed);
+    error_http += slot.error_http.load(memory_order_relaxed);
+    error_partial += slot.error_partial.load(memory_order_relaxed);
+    size_upload += slot.size_upload.load(memory_order_relaxed);
+    size_download += slot.size_download.load(memory_order_relaxed);
+    size_upload_decoded += slot.size_upload_decoded.load(memory_order_relaxed);
+    size_download_decoded += slot.size_download_decoded.load(memory_order_relaxed);
+    docs += slot.docs.load(memory_order_relaxed);
+    time_transfer += slot.time_transfer.load(memory_order_relaxed);
+    time_response += slot.time_response.load(memory_order_relaxed);
+    time_took += slot.time_took.load(memory_order_relaxed);
+    slot.transfer.AddTo(&transfer);
+    slot.response.AddTo(&response);
+    slot.took.AddTo(&took);
+    slot.lag.AddTo(&lag);
+    slot.lateness.AddTo(&lateness);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        time_phases[i] += slot.time_phases[i].load(memory_order_relaxed);
+        slot.phases[i].AddTo(&phases[i]);
+    }
+    connects += slot.connects.load(memory_order_relaxed);
+    sessions += slot.sessions.load(memory_order_relaxed);
+    sessions_failed += slot.sessions_failed.load(memory_order_relaxed);
+    for (int i = 0; i < STATUS_CODES; i++) statuses[i] += slot.statuses[i].load(memory_order_relaxed);
+    for (int i = 0; i < CURL_CODES; i++) curl_errors[i] += slot.curl_errors[i].load(memory_order_relaxed);
+    rejections += slot.rejections.load(memory_order_relaxed);
+    retries += slot.retries.load(memory_order_relaxed);
+    retries_denied += slot.retries_denied.load(memory_order_relaxed);
+    time_retried += slot.time_retried.load(memory_order_relaxed);
+    slot.retried.AddTo(&retried);
+    if (queries.size() < slot.queries.size()) queries.resize(slot.queries.size());
+    for (size_t i = 0; i < slot.queries.size(); i++) {
+        queries[i].Add(*slot.queries[i]);
+    }
+    if (nodes.size() < slot.nodes.size()) nodes.resize(slot.nodes.size());
+    for (size_t i = 0; i < slot.nodes.size(); i++) {
+        nodes[i].Add(*slot.nodes[i]);
+    }
+    if (pages.size() < slot.pages.size()) pages.resize(slot.pages.size());
+    for (size_t i = 0; i < slot.pages.size(); i++) {
+        pages[i].Add(*slot.pages[i]);
+    }
+}
+
+void Metrics::Add(const Metrics &other) {
+    success += other.success;
+    error_curl += other.error_curl;
+    error_http += other.error_http;
+    error_partial += other.error_partial;
+    size_upload += other.size_upload;
+    size_download += other.size_download;
+    size_upload_decoded += other.size_upload_decoded;
+    size_download_decoded += other.size_download_decoded;
+    docs += other.docs;
+    time_transfer += other.time_transfer;
+    time_response += other.time_response;
+    time_took += other.time_took;
+    transfer.Add(other.transfer);
+    response.Add(other.response);
+    took.Add(other.took);
+    lag.Add(other.lag);
+    lateness.Add(other.lateness);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        time_phases[i] += other.time_phases[i];
+        phases[i].Add(other.phases[i]);
+    }
+    connects += other.connects;
+    sessions += other.sessions;
+    sessions_failed += other.sessions_failed;
+    for (int i = 0; i < STATUS_CODES; i++) statuses[i] += other.statuses[i];
+    for (int i = 0; i < CURL_CODES; i++) curl_errors[i] += other.curl_errors[i];
+    rejections += other.rejections;
+    retries += other.retries;
+    retries_denied += other.retries_denied;
+    time_retried += other.time_retried;
+    retried.Add(other.retried);
+    cpu += other.cpu;
+    cpu_available += other.cpu_available;
+    switches_voluntary += other.switches_voluntary;
+    switches_involuntary += other.switches_involuntary;
+    threads.Add(other.threads);
+    if (queries.size() < other.queries.size()) queries.resize(other.queries.size());
+    for (size_t i = 0; i < other.queries.size(); i++) {
+        queries[i].Add(other.queries[i]);
+    }
+    if (nodes.size() < other.nodes.size()) nodes.resize(other.nodes.size());
+    for (size_t i = 0; i < other.nodes.size(); i++) {
+        nodes[i].Add(other.nodes[i]);
+    }
+    if (pages.size() < other.pages.size()) pages.resize(other.pages.size());
+    for (size_t i = 0; i < other.pages.size(); i++) {
+        pages[i].Add(other.pages[i]);
+    }
+}
+
+void Metrics::Subtract(const Metrics &earlier) {
+    success -= earlier.success;
+    error_curl -= earlier.error_curl;
+    error_http -= earlier.error_http;
+    error_partial -= earlier.error_partial;
+    size_upload -= earlier.size_upload;
+    size_download -= earlier.size_download;
+    size_upload_decoded -= earlier.size_upload_decoded;
+    size_download_decoded -= earlier.size_download_decoded;
+    docs -= earlier.docs;
+    time_transfer -= earlier.time_transfer;
+    time_response -= earlier.time_response;
+    time_took -= earlier.time_took;
+    transfer.Subtract(earlier.transfer);
+    response.Subtract(earlier.response);
+    took.Subtract(earlier.took);
+    lag.Subtract(earlier.lag);
+    lateness.Subtract(earlier.lateness);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        time_phases[i] -= earlier.time_phases[i];
+        phases[i].Subtract(earlier.phases[i]);
+    }
+    connects -= earlier.connects;
+    sessions -= earlier.sessions;
+    sessions_failed -= earlier.sessions_failed;
+    for (int i = 0; i < STATUS_CODES; i++) statuses[i] -= earlier.statuses[i];
+    for (int i = 0; i < CURL_CODES; i++) curl_errors[i] -= earlier.curl_errors[i];
+    rejections -= earlier.rejections;
+    retries -= earlier.retries;
+    retries_denied -= earlier.retries_denied;
+    time_retried -= earlier.time_retried;
+    retried.Subtract(earlier.retried);
+    cpu -= earlier.cpu;
+    cpu_available -= earlier.cpu_available;
+    switches_voluntary -= earlier.switches_voluntary;
+    switches_involuntary -= earlier.switches_involuntary;
+    threads.Subtract(earlier.threads);
+    for (size_t i = 0; i < queries.size() && i < earlier.queries.size(); i++) {
+        queries[i].Subtract(earlier.queries[i]);
+    }
+    for (size_t i = 0; i < nodes.size() && i < earlier.nodes.size(); i++) {
+        nodes[i].Subtract(earlier.nodes[i]);
+    }
+    for (size_t i = 0; i < pages.size() && i < earlier.pages.size(); i++) {
+        pages[i].Subtract(earlier.pages[i]);
+    }
+}
+
+void Metrics::Encode(string *out) const {
+    const u_long counters[] = {success, error_curl, error_http, error_partial, size_upload, size_download,
+                               size_upload_decoded, size_download_decoded, docs, time_transfer, time_response,
+                               time_took, connects, sessions, sessions_failed, cpu, cpu_available,
+                               switches_voluntary, switches_involuntary, rejections, retries, retries_denied,
+                               time_retried};
+    for (u_long counter : counters) Channel::PutNumber(out, counter);
+    EncodeCounts(statuses, STATUS_CODES, out);
+    EncodeCounts(curl_errors, CURL_CODES, out);
+    EncodeHistogram(transfer, out);
+    EncodeHistogram(response, out);
+    EncodeHistogram(took, out);
+    EncodeHistogram(lag, out);
+    EncodeHistogram(lateness, out);
+    EncodeHistogram(threads, out);
+    EncodeHistogram(retried, out);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        Channel::PutNumber(out, time_phases[i]);
+        EncodeHistogram(phases[i], out);
+    }
+    Channel::PutNumber(out, queries.size());
+    for (const GroupMetrics &query : queries) query.Encode(out);
+    Channel::PutNumber(out, nodes.size());
+    for (const GroupMetrics &node : nodes) node.Encode(out);
+    Channel::PutNumber(out, pages.size());
+    for (const GroupMetrics &page : pages) page.Encode(out);
+}
+
+// Add the decoded counters, in the order Encode writes them
+bool Metrics::Decode(const string &in, size_t *pos) {
+    u_long *counters[] = {&success, &error_curl, &error_http, &error_partial, &size_upload, &size_download,
+                          &size_upload_decoded, &size_download_decoded, &docs, &time_transfer, &time_response,
+                          &time_took, &connects, &sessions, &sessions_failed, &cpu, &cpu_available,
+                          &switches_voluntary, &switches_involuntary, &rejections, &retries, &retries_denied,
+                          &time_retried};
+    for (u_long *counter : counters) {
+        if (!DecodeNumber(in, pos, counter)) return false;
+    }
+    if (!DecodeCounts(in, pos, statuses, STATUS_CODES) || !DecodeCounts(in, pos, curl_errors, CURL_CODES)) {
+        return false;
+    }
+    if (!DecodeHistogram(in, pos, &transfer) || !DecodeHistogram(in, pos, &response) ||
+        !DecodeHistogram(in, pos, &took) || !DecodeHistogram(in, pos, &lag) ||
+        !DecodeHistogram(in, pos, &lateness) || !DecodeHistogram(in, pos, &threads) ||
+        !DecodeHistogram(in, pos, &retried)) {
+        return false;
+    }
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (!DecodeNumber(in, pos, &time_phases[i]) || !DecodeHistogram(in, pos, &phases[i])) return false;
+    }
+    for (vector<GroupMetrics> *groups : {&queries, &nodes, &pages}) {
+        uint64_t size;
+        if (!Channel::GetNumber(in, pos, &size) || size > in.size()) return false;
+        if (groups->size() < size) groups->resize(size);
+        for (uint64_t i = 0; i < size; i++) {
+            if (!(*groups)[i].Decode(in, pos)) return false;
+        }
+    }
+    return true;
+}
+
+void GroupMetrics::Add(const GroupSlot &slot) {
+    success += slot.success.load(memory_order_relaxed);
+    error_curl += slot.error_curl.load(memory_order_relaxed);
+    error_http += slot.error_http.load(memory_order_relaxed);
+    error_partial += slot.error_partial.load(memory_order_relaxed);
+    time_latency += slot.time_latency.load(memory_order_relaxed);
+    slot.latency.AddTo(&latency);
+}
+
+void GroupMetrics::Add(const GroupMetrics &other) {
+    success += other.success;
+    error_curl += other.error_curl;
+    error_http += other.error_http;
+    error_partial += other.error_partial;
+    time_latency += other.time_latency;
+    latency.Add(other.latency);
+}
+
+void GroupMetrics::Subtract(const GroupMetrics &earlier) {
+    success -= earlier.success;
+    error_curl -= earlier.error_curl;
+    error_http -= earlier.error_http;
+    error_partial -= earlier.error_partial;
+    time_latency -= earlier.time_latency;
+    latency.Subtract(earlier.latency);
+}
+
+void GroupMetrics::Encode(string *out) const {
+    const u_long counters[] = {success, error_curl, error_http, error_partial, time_latency};
+    for (u_long counter : counters) Channel::PutNumber(out, counter);
+    EncodeHistogram(latency, out);
+}
+
+bool GroupMetrics::Decode(const string &in, size_t *pos) {
+    u_long *counters[] = {&success, &error_curl, &error_http, &error_partial, &time_latency};
+    for (u_long *counter : counters) {
+        if (!DecodeNumber(in, pos, counter)) return false;
+    }
+    return DecodeHistogram(in, pos, &latency);
+}
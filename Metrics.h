@@ -0,0 +1,220 @@
+//
+// Per-worker statistics slots and their merged snapshots
+//
+
+#ifndef ESPERF_METRICS_H
+#define ESPERF_METRICS_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "Histogram.h"
+
+using namespace std;
+
+static const size_t CACHE_LINE_SIZE = 64;
+
+// Phases of a transfer taken from the curl timings, each from the end of the previous one
+enum Phase { PHASE_LOOKUP, PHASE_CONNECT, PHASE_TLS, PHASE_PRETRANSFER, PHASE_TTFB, PHASE_DOWNLOAD, PHASE_COUNT };
+
+// Slots of the counters by HTTP status and by curl error, those beyond fall into the last one
+static const int STATUS_CODES = 600;
+static const int CURL_CODES = 128;
+
+// How a request ended its session
+enum SessionEnd { SESSION_GOING, SESSION_COMPLETED, SESSION_FAILED };
+
+// Outcome of a single request, filled by the worker
+struct RequestResult {
+    int success = 0;
+    int error_curl = 0;
+    int error_http = 0;
+    // Successful HTTP response reporting timed_out, failed shards or bulk errors
+    int error_partial = 0;
+    // Bytes on the wire, and before compression or after decoding
+    u_long size_upload = 0;
+    u_long size_download = 0;
+    u_long size_upload_decoded = 0;
+    u_long size_download_decoded = 0;
+    // Documents in a successful _bulk request
+    u_long docs = 0;
+    double time_transfer = 0.0;
+    // From the intended send time
+    double time_response = 0.0;
+    // took of the response, negative if it has none
+    double time_took = -1.0;
+    // Seconds spent in every phase of a successful transfer
+    double time_phases[PHASE_COUNT] = {};
+    // Connections newly opened for the request, 0 if it reused one
+    u_long connects = 0;
+    // Index of the query in the workload
+    size_t query = 0;
+    // Index of the node the request was sent to
+    size_t node = 0;
+    // Step of a session, 0 for the open, the page and the last one for the close, -1 outside of sessions
+    int step = -1;
+    SessionEnd session_end = SESSION_GOING;
+    // HTTP status of the response, 0 without one, and the CURLcode of the transfer
+    long status = 0;
+    int curl_code = 0;
+    // Errors of the response which are rejected executions, the cluster pushing back on a full queue
+    u_long rejections = 0;
+    // Retries the request went through, and whether this attempt is sent again or was denied it by the budget
+    u_int retries = 0;
+    bool retrying = false;
+    bool retry_denied = false;
+};
+
+// Counters of a part of the requests of a single worker, such as a query of the workload
+struct GroupSlot {
+    atomic<u_long> success{0};
+    atomic<u_long> error_curl{0};
+    atomic<u_long> error_http{0};
+    atomic<u_long> error_partial{0};
+    // Sum and histogram in usec of the reported latency
+    atomic<u_long> time_latency{0};
+    AtomicHistogram latency;
+};
+
+// Counters of a single worker, only the owner thread writes them
+struct MetricsSlot {
+    // The owner is the only writer, so a relaxed load and store replaces the locked add
+    static void Add(atomic<u_long> *counter, const u_long value) {
+        counter->store(counter->load(memory_order_relaxed) + value, memory_order_relaxed);
+    }
+
+    // Keep the counters off the cache lines of the neighbouring allocations
+    char padding_head[CACHE_LINE_SIZE];
+
+    atomic<u_long> success{0};
+    atomic<u_long> error_curl{0};
+    atomic<u_long> error_http{0};
+    atomic<u_long> error_partial{0};
+    atomic<u_long> size_upload{0};
+    atomic<u_long> size_download{0};
+    atomic<u_long> size_upload_decoded{0};
+    atomic<u_long> size_download_decoded{0};
+    atomic<u_long> docs{0};
+    // Sums in usec
+    atomic<u_long> time_transfer{0};
+    atomic<u_long> time_response{0};
+    atomic<u_long> time_took{0};
+
+    // Latency histograms in usec
+    AtomicHistogram transfer;
+    AtomicHistogram response;
+    // Server side took of the successful responses which have it
+    AtomicHistogram took;
+    // Lags of the open-loop requests sent behind the schedule
+    AtomicHistogram lag;
+    // How late every replayed request is sent against its time in the log
+    AtomicHistogram lateness;
+
+    // Sums and histograms in usec of the phases, and the connections opened
+    atomic<u_long> time_phases[PHASE_COUNT] = {};
+    AtomicHistogram phases[PHASE_COUNT];
+    atomic<u_long> connects{0};
+
+    // Sessions gone through all their pages, and those cut short by a failed request
+    atomic<u_long> sessions{0};
+    atomic<u_long> sessions_failed{0};
+
+    // Every attempt by its HTTP status and curl error, the rejected executions and the retries sent or denied
+    atomic<u_long> statuses[STATUS_CODES] = {};
+    atomic<u_long> curl_errors[CURL_CODES] = {};
+    atomic<u_long> rejections{0};
+    atomic<u_long> retries{0};
+    atomic<u_long> retries_denied{0};
+    // Sum and histogram in usec of the successful requests which needed a retry, from their first intended send time
+    atomic<u_long> time_retried{0};
+    AtomicHistogram retried;
+
+    // Broken out by the queries of the workload, if it has more than one
+    vector<unique_ptr<GroupSlot>> queries;
+    // Broken out by the nodes, if there is more than one
+    vector<unique_ptr<GroupSlot>> nodes;
+    // Broken out by the steps of the sessions, if the workload has any
+    vector<unique_ptr<GroupSlot>> pages;
+
+    char padding_tail[CACHE_LINE_SIZE];
+};
+
+struct GroupMetrics {
+    u_long success = 0;
+    u_long error_curl = 0;
+    u_long error_http = 0;
+    u_long error_partial = 0;
+    u_long time_latency = 0;
+    Histogram latency;
+
+    void Add(const GroupSlot &slot);
+
+    void Add(const GroupMetrics &other);
+
+    void Subtract(const GroupMetrics &earlier);
+
+    void Encode(string *out) const;
+
+    bool Decode(const string &in, size_t *pos);
+};
+
+// Merged counters of all the workers at a point in time
+struct Metrics {
+    u_long success = 0;
+    u_long error_curl = 0;
+    u_long error_http = 0;
+    u_long error_partial = 0;
+    u_long size_upload = 0;
+    u_long size_download = 0;
+    u_long size_upload_decoded = 0;
+    u_long size_download_decoded = 0;
+    u_long docs = 0;
+    u_long time_transfer = 0;
+    u_long time_response = 0;
+    u_long time_took = 0;
+    Histogram transfer;
+    Histogram response;
+    Histogram took;
+    Histogram lag;
+    Histogram lateness;
+    u_long time_phases[PHASE_COUNT] = {};
+    Histogram phases[PHASE_COUNT];
+    u_long connects = 0;
+    u_long sessions = 0;
+    u_long sessions_failed = 0;
+    u_long statuses[STATUS_CODES] = {};
+    u_long curl_errors[CURL_CODES] = {};
+    u_long rejections = 0;
+    u_long retries = 0;
+    u_long retries_denied = 0;
+    u_long time_retried = 0;
+    Histogram retried;
+    // CPU of the client process itself and of the CPUs it may run on in usec, and its context switches
+    u_long cpu = 0;
+    u_long cpu_available = 0;
+    u_long switches_voluntary = 0;
+    u_long switches_involuntary = 0;
+    // CPU usec per second of each worker thread over every interval
+    Histogram threads;
+    vector<GroupMetrics> queries;
+    vector<GroupMetrics> nodes;
+    vector<GroupMetrics> pages;
+
+    void Add(const MetricsSlot &slot);
+
+    // Merge the counters of another process, such as an agent
+    void Add(const Metrics &other);
+
+    // Take the difference from an earlier snapshot
+    void Subtract(const Metrics &earlier);
+
+    // Serialize for the coordinator, only the non-zero counts of the histograms are written
+    void Encode(string *out) const;
+
+    bool Decode(const string &in, size_t *pos);
+};
+
+#endif //ESPERF_METRICS_H
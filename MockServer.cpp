@@ -0,0 +1,377 @@
+//
+// Loopback mock of Elasticsearch answering _search and _bulk with canned responses,
+// to measure esperf itself and to try changes without a cluster
+//
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Random.h"
+
+using namespace std;
+
+static const string COMMAND_LINE_OPTIONS_MSG = "Usage: esperf-mock [-h] [-p port] [-t num_threads] [-l latency_msec] [-j jitter_msec] [-e error_percent] [-x partial_percent]";
+
+static const size_t READ_BUFFER_SIZE = 65536;
+static const int LISTEN_BACKLOG = 1024;
+
+static const string SEARCH_BODY = "{\"took\":%TOOK%,\"timed_out\":false,\"_shards\":{\"total\":1,\"successful\":1,\"skipped\":0,\"failed\":0},\"hits\":{\"total\":{\"value\":0,\"relation\":\"eq\"},\"max_score\":null,\"hits\":[]}}";
+static const string SEARCH_PARTIAL_BODY = "{\"took\":%TOOK%,\"timed_out\":true,\"_shards\":{\"total\":2,\"successful\":1,\"skipped\":0,\"failed\":1},\"hits\":{\"total\":{\"value\":0,\"relation\":\"eq\"},\"max_score\":null,\"hits\":[]}}";
+static const string BULK_BODY = "{\"took\":%TOOK%,\"errors\":false,\"items\":[]}";
+static const string BULK_PARTIAL_BODY = "{\"took\":%TOOK%,\"errors\":true,\"items\":[]}";
+static const string ERROR_BODY = "{\"error\":{\"type\":\"es_rejected_execution_exception\",\"reason\":\"rejected by esperf-mock\"},\"status\":429}";
+
+struct MockOptions {
+    int port = 9200;
+    u_int num_threads = 1;
+    // Fixed delay of every response plus a uniform random part
+    u_int latency_msec = 0;
+    u_int jitter_msec = 0;
+    // Share of the requests answered with HTTP 429, and with a partial failure in a 200 response
+    double error_percent = 0.0;
+    double partial_percent = 0.0;
+};
+
+// A response waiting for its send time
+struct Pending {
+    chrono::steady_clock::time_point due;
+    string data;
+    bool close;
+};
+
+// Incremental parser of the requests on a keep-alive connection, which discards the bodies as they arrive
+struct Connection {
+    enum State { HEADERS, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILER };
+
+    int fd;
+    State state = HEADERS;
+    string head;
+    string line;
+    size_t remaining = 0;
+    bool bulk = false;
+    bool close = false;
+    deque<Pending> pending;
+    string out;
+    size_t out_pos = 0;
+    bool closing = false;
+};
+
+class MockServer {
+public:
+    MockServer(const MockOptions *options, u_int id) : options_(options), random_(id + 1) {}
+
+    void Run();
+
+private:
+    const MockOptions *options_;
+    Random random_;
+    int listen_fd_ = -1;
+    vector<Connection> connections_;
+
+    bool Listen();
+
+    void Accept();
+
+    // Read what has arrived, return false once the connection is gone
+    bool Receive(Connection *connection);
+
+    void Consume(Connection *connection, const char *data, size_t length);
+
+    void ParseHead(Connection *connection);
+
+    void Respond(Connection *connection);
+
+    // Move the due responses to the output and write as much as the socket takes
+    bool Send(Connection *connection, chrono::steady_clock::time_point now);
+};
+
+void MockServer::Run() {
+    if (!Listen()) return;
+
+    vector<pollfd> fds;
+    while (true) {
+        // The poll timeout is the earliest due response
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        int timeout_ms = -1;
+        fds.clear();
+        fds.push_back(pollfd{listen_fd_, POLLIN, 0});
+        for (Connection &connection : connections_) {
+            short events = POLLIN;
+            if (connection.out_pos < connection.out.size()) events |= POLLOUT;
+            fds.push_back(pollfd{connection.fd, events, 0});
+            if (!connection.pending.empty()) {
+                long wait = chrono::duration_cast<chrono::milliseconds>(connection.pending.front().due - now).count();
+                wait = max(0L, wait);
+                if (timeout_ms < 0 || wait < timeout_ms) timeout_ms = static_cast<int>(wait);
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR) break;
+        now = chrono::steady_clock::now();
+
+        // Connections accepted now are polled from the next round
+        size_t polled = fds.size() - 1;
+        if (fds[0].revents & POLLIN) Accept();
+
+        vector<Connection> alive;
+        for (size_t i = 0; i < connections_.size(); i++) {
+            Connection &connection = connections_[i];
+            bool ok = true;
+            if (i < polled && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) ok = Receive(&connection);
+            if (ok) ok = Send(&connection, now);
+            if (ok) {
+                alive.push_back(move(connection));
+            } else {
+                close(connection.fd);
+            }
+        }
+        connections_.swap(alive);
+    }
+}
+
+bool MockServer::Listen() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        cerr << "Error: socket() failed: " << strerror(errno) << endl;
+        return false;
+    }
+    int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // Every thread listens on the port, and the kernel spreads the connections over them
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(options_->port));
+    if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, LISTEN_BACKLOG) != 0) {
+        cerr << "Error: cannot listen on port " << options_->port << ": " << strerror(errno) << endl;
+        close(listen_fd_);
+        return false;
+    }
+    fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void MockServer::Accept() {
+    while (true) {
+        int fd = accept(listen_fd_, NULL, NULL);
+        if (fd < 0) return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        Connection connection;
+        connection.fd = fd;
+        connections_.push_back(move(connection));
+    }
+}
+
+bool MockServer::Receive(Connection *connection) {
+    char buffer[READ_BUFFER_SIZE];
+    while (true) {
+        ssize_t length = recv(connection->fd, buffer, sizeof(buffer), 0);
+        if (length > 0) {
+            Consume(connection, buffer, static_cast<size_t>(length));
+            continue;
+        }
+        if (length == 0) return false;
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+}
+
+void MockServer::Consume(Connection *connection, const char *data, size_t length) {
+    size_t pos = 0;
+    while (pos < length) {
+        switch (connection->state) {
+            case Connection::HEADERS: {
+                // Headers end at an empty line
+                const char *end = static_cast<const char *>(memchr(data + pos, '\n', length - pos));
+                size_t next = end ? static_cast<size_t>(end - data) + 1 : length;
+                connection->line.append(data + pos, next - pos);
+                pos = next;
+                if (!end) break;
+                if (connection->line == "\r\n" || connection->line == "\n") {
+                    connection->line.clear();
+                    ParseHead(connection);
+                } else {
+                    connection->head += connection->line;
+                    connection->line.clear();
+                }
+                break;
+            }
+            case Connection::BODY: {
+                size_t take = min(connection->remaining, length - pos);
+                connection->remaining -= take;
+                pos += take;
+                if (connection->remaining == 0) Respond(connection);
+                break;
+            }
+            case Connection::CHUNK_SIZE:
+            case Connection::CHUNK_END:
+            case Connection::TRAILER: {
+                const char *end = static_cast<const char *>(memchr(data + pos, '\n', length - pos));
+                size_t next = end ? static_cast<size_t>(end - data) + 1 : length;
+                connection->line.append(data + pos, next - pos);
+                pos = next;
+                if (!end) break;
+                if (connection->state == Connection::CHUNK_SIZE) {
+                    connection->remaining = strtoul(connection->line.c_str(), NULL, 16);
+                    connection->state = connection->remaining > 0 ? Connection::CHUNK_DATA : Connection::TRAILER;
+                } else if (connection->state == Connection::CHUNK_END) {
+                    connection->state = Connection::CHUNK_SIZE;
+                } else if (connection->line == "\r\n" || connection->line == "\n") {
+                    Respond(connection);
+                }
+                connection->line.clear();
+                break;
+            }
+            case Connection::CHUNK_DATA: {
+                size_t take = min(connection->remaining, length - pos);
+                connection->remaining -= take;
+                pos += take;
+                if (connection->remaining == 0) connection->state = Connection::CHUNK_END;
+                break;
+            }
+        }
+    }
+}
+
+// Find the path and how the body is framed
+void MockServer::ParseHead(Connection *connection) {
+    string head = connection->head;
+    for (char &c : head) c = static_cast<char>(tolower(c));
+    size_t path_end = head.find(" http/");
+    connection->bulk = head.substr(0, path_end).find("_bulk") != string::npos;
+    connection->close = head.find("\nconnection: close") != string::npos;
+
+    size_t content_length = 0;
+    size_t found = head.find("\ncontent-length:");
+    if (found != string::npos) content_length = strtoul(head.c_str() + found + 16, NULL, 10);
+    bool chunked = head.find("\ntransfer-encoding: chunked") != string::npos;
+
+    // curl waits up to a second for the go-ahead before it sends a large or streamed body
+    if (head.find("\nexpect: 100-continue") != string::npos) {
+        Pending pending;
+        pending.due = connection->pending.empty() ? chrono::steady_clock::now() : connection->pending.back().due;
+        pending.data = "HTTP/1.1 100 Continue\r\n\r\n";
+        pending.close = false;
+        connection->pending.push_back(move(pending));
+    }
+
+    if (chunked) {
+        connection->state = Connection::CHUNK_SIZE;
+    } else if (content_length > 0) {
+        connection->state = Connection::BODY;
+        connection->remaining = content_length;
+    } else {
+        Respond(connection);
+    }
+}
+
+void MockServer::Respond(Connection *connection) {
+    connection->state = Connection::HEADERS;
+    connection->head.clear();
+
+    u_int delay = options_->latency_msec;
+    if (options_->jitter_msec > 0) delay += static_cast<u_int>(random_.Uniform(options_->jitter_msec + 1));
+
+    double draw = random_.NextDouble() * 100.0;
+    string status = "200 OK";
+    string body;
+    if (draw < options_->error_percent) {
+        status = "429 Too Many Requests";
+        body = ERROR_BODY;
+    } else if (draw < options_->error_percent + options_->partial_percent) {
+        body = connection->bulk ? BULK_PARTIAL_BODY : SEARCH_PARTIAL_BODY;
+    } else {
+        body = connection->bulk ? BULK_BODY : SEARCH_BODY;
+    }
+    size_t took = body.find("%TOOK%");
+    if (took != string::npos) body.replace(took, 6, to_string(delay));
+
+    Pending pending;
+    pending.due = chrono::steady_clock::now() + chrono::milliseconds(delay);
+    // Responses of a connection go out in order, even when the jitter would swap them
+    if (!connection->pending.empty() && pending.due < connection->pending.back().due) {
+        pending.due = connection->pending.back().due;
+    }
+    pending.data = "HTTP/1.1 " + status + "\r\nContent-Type: application/json; charset=UTF-8\r\nContent-Length: " +
+                   to_string(body.size()) + "\r\n" + (connection->close ? "Connection: close\r\n" : "") + "\r\n" +
+                   body;
+    pending.close = connection->close;
+    connection->pending.push_back(move(pending));
+}
+
+bool MockServer::Send(Connection *connection, chrono::steady_clock::time_point now) {
+    while (!connection->pending.empty() && connection->pending.front().due <= now && !connection->closing) {
+        connection->out += connection->pending.front().data;
+        connection->closing = connection->pending.front().close;
+        connection->pending.pop_front();
+    }
+    while (connection->out_pos < connection->out.size()) {
+        ssize_t length = send(connection->fd, connection->out.data() + connection->out_pos,
+                              connection->out.size() - connection->out_pos, MSG_NOSIGNAL);
+        if (length < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        connection->out_pos += static_cast<size_t>(length);
+    }
+    connection->out.clear();
+    connection->out_pos = 0;
+    return !connection->closing;
+}
+
+int main(int argc, char **argv) {
+    MockOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "hp:t:l:j:e:x:")) != EOF)
+        switch (opt) {
+            case 'p':
+                options.port = atoi(optarg);
+                break;
+            case 't':
+                options.num_threads = static_cast<u_int>(atoi(optarg));
+                break;
+            case 'l':
+                options.latency_msec = static_cast<u_int>(atoi(optarg));
+                break;
+            case 'j':
+                options.jitter_msec = static_cast<u_int>(atoi(optarg));
+                break;
+            case 'e':
+                options.error_percent = atof(optarg);
+                break;
+            case 'x':
+                options.partial_percent = atof(optarg);
+                break;
+            default:
+                cout << COMMAND_LINE_OPTIONS_MSG << endl;
+                return EXIT_FAILURE;
+        }
+    if (options.num_threads < 1) options.num_threads = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    cout << "esperf-mock listening on 127.0.0.1:" << options.port << " with " << options.num_threads << " threads"
+         << endl;
+    vector<thread> threads;
+    for (u_int i = 0; i < options.num_threads; i++) {
+        threads.push_back(thread(&MockServer::Run, MockServer(&options, i)));
+    }
+    for (thread &th : threads) th.join();
+    return EXIT_FAILURE;
+}
@@ -4,28 +4,147 @@
 //
 
 #include "Options.h"
+#include "Channel.h"
+#include "Search.h"
 
-static const string COMMAND_LINE_OPTIONS_MSG = "Usage: esperf [-v] [-d dictionary_file] [-i interval_sec] [-w warm_up_sec] [-r recurrence] [-t num_threads] [-u user:password] [-T timeout] [-X method] url";
+static const string COMMAND_LINE_OPTIONS_MSG = "Usage: esperf [-v] [-a] [-g] [-B docs_per_request] [-b balance] [-C baseline_file] [-c connections] [-D duration_sec] [-d dictionary_file] [-F jsonl|csv] [-f workload_file] [-G thresholds] [-H 1.1|2|2c] [-i interval_sec] [-K cpus] [-k requests_per_connection] [-L cpus] [-l log_file] [-e log_sampling] [-m streams] [-M max_connections] [-N] [-n node_urls] [-o output_file] [-p [host:]metrics_port] [-P replay_file] [-x speed] [-Q objective] [-q probe_sec] [-y retry_policy] [-w warm_up_sec] [-r recurrence] [-R requests_per_sec] [-s seed] [-S stage_file] [-t num_threads] [-u user:password] [-z distribution] [-T timeout] [-W agents] [-X method] url\n       esperf -A [host:]port";
 static const string OPTIONS_HEADER = "----------------------------------- Options ------------------------------------";
 
 // Parse command line options and keep by instance variables
 int Options::Parse(int argc, char **argv)
 {
     int opt;
-    while ((opt = getopt(argc, argv,"vhX:d:i:w:T:r:t:u:")) != EOF)
+    while ((opt = getopt(argc, argv,"vhaNgA:B:X:b:C:c:D:d:e:F:f:G:H:i:K:k:L:l:m:M:n:o:p:P:Q:q:w:T:r:R:s:S:t:u:W:x:y:z:")) != EOF) {
+        arguments_.push_back(make_pair(static_cast<char>(opt), optarg ? string(optarg) : string()));
         switch(opt)
         {
+            case 'a':
+                accept_encoding_ = true;
+                break;
+            case 'A':
+                if (!Channel::ParseListenAddress(optarg, &agent_host_, &agent_port_)) {
+                    cout << "Error: -A must be [host:]port: " << optarg << endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'g':
+                gzip_request_ = true;
+                break;
+            case 'B':
+                bulk_docs_ = (u_int) atoi(optarg);
+                break;
+            case 'b':
+                if (!Balancer::ParsePolicy(optarg, &balance_policy_)) {
+                    cout << "Error: unknown balance " << optarg << endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'C':
+                baseline_filename_ = optarg;
+                break;
+            case 'c':
+                num_connections_ = (u_int) atoi(optarg);
+                break;
+            case 'D':
+                duration_sec_ = atof(optarg);
+                break;
             case 'd':
                 dict_filename_ = optarg;
                 break;
+            case 'F':
+                if (!Report::ParseFormat(optarg, &output_format_)) {
+                    cout << "Error: unknown output format " << optarg << endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f':
+                workload_filename_ = optarg;
+                break;
+            case 'G':
+                thresholds_ = optarg;
+                thresholds_specified_ = true;
+                break;
+            case 'H':
+                http_version_ = optarg;
+                if (http_version_ == "1.1") {
+                    curl_http_version_ = CURL_HTTP_VERSION_1_1;
+                } else if (http_version_ == "2") {
+                    curl_http_version_ = CURL_HTTP_VERSION_2TLS;
+                } else if (http_version_ == "2c") {
+                    curl_http_version_ = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+                } else {
+                    cout << "Error: unknown HTTP version " << optarg << endl;
+                    return EXIT_FAILURE;
+                }
+                break;
             case 'i':
                 interval_sec_ = (u_int) atoi(optarg);
                 break;
+            case 'k':
+                requests_per_connection_ = static_cast<u_int>(atoi(optarg));
+                break;
+            case 'm':
+                max_streams_ = static_cast<u_int>(atoi(optarg));
+                break;
+            case 'M':
+                max_connections_ = static_cast<u_int>(atoi(optarg));
+                break;
+            case 'N':
+                tcp_nodelay_ = false;
+                break;
+            case 'n': {
+                // Comma separated, empty entries are skipped
+                stringstream node_list(optarg);
+                for (string node; getline(node_list, node, ',');) {
+                    // A trailing slash would double the one of the path
+                    while (!node.empty() && node.back() == '/') node.pop_back();
+                    if (!node.empty()) nodes_.push_back(node);
+                }
+                break;
+            }
+            case 'o':
+                output_filename_ = optarg;
+                break;
+            case 'l':
+                log_filename_ = optarg;
+                break;
+            case 'e':
+                log_sampling_ = optarg;
+                break;
+            case 'p':
+                if (!Channel::ParseListenAddress(optarg, &metrics_host_, &metrics_port_)) {
+                    cout << "Error: -p must be [host:]port: " << optarg << endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'P':
+                replay_filename_ = optarg;
+                break;
+            case 'Q':
+                objective_ = optarg;
+                break;
+            case 'q':
+                probe_sec_ = atof(optarg);
+                break;
+            case 'y':
+                retry_spec_ = optarg;
+                break;
             case 'w':
                 warmup_sec_ = (u_int) atoi(optarg);
                 break;
             case 'r':
                 num_recurrence_ =  (u_int) atoi(optarg);
+                recurrence_specified_ = true;
+                break;
+            case 'R':
+                request_rate_ = atof(optarg);
+                break;
+            case 's':
+                seed_ = strtoull(optarg, NULL, 10);
+                seed_specified_ = true;
+                break;
+            case 'S':
+                stages_filename_ = optarg;
                 break;
             case 't':
                 num_threads_ = (u_int) atoi(optarg);
@@ -33,19 +152,44 @@ int Options::Parse(int argc, char **argv)
             case 'u':
                 http_user_ = optarg;
                 break;
+            case 'z':
+                dict_distribution_ = optarg;
+                break;
             case 'T':
                 timeout_sec_ = static_cast<u_int>(atoi(optarg));
                 break;
             case 'v':
                 verbose_ = true;
                 break;
+            case 'W': {
+                stringstream agent_list(optarg);
+                for (string agent; getline(agent_list, agent, ',');) {
+                    if (!agent.empty()) agents_.push_back(agent);
+                }
+                break;
+            }
             case 'X':
                 http_method_ = optarg;
                 break;
+            case 'x':
+                replay_speed_ = atof(optarg);
+                break;
+            case 'K':
+                worker_cpus_spec_ = optarg;
+                break;
+            case 'L':
+                timer_cpus_spec_ = optarg;
+                break;
             default:
                 cout << COMMAND_LINE_OPTIONS_MSG << endl;
                 return EXIT_FAILURE;
         }
+    }
+
+    // An agent takes the rest from the coordinator
+    if (agent_port_ > 0) return EXIT_SUCCESS;
+
+    if (num_connections_ < 1) num_connections_ = 1;
 
     // Get url from command line
     if (!argv[optind]) {
@@ -56,25 +200,200 @@ int Options::Parse(int argc, char **argv)
         request_url_ = argv[optind];
     }
 
-    // Read dictionary
+    // Map dictionary
     if (dict_filename_.size() > 0) {
-        ifstream if_dict(dict_filename_);
-        string str_line;
-        while (getline(if_dict, str_line))
-            dict_.push_back(str_line);
+        string error;
+        if (!dict_.Load(dict_filename_, &error) || !dict_.SetDistribution(dict_distribution_, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The streams of an HTTP/2 connection are not its own, closing it after some of them cuts the others short. The
+    // pool capped by -M is shared by the transfers likewise
+    if (requests_per_connection_ > 0 && curl_http_version_ != CURL_HTTP_VERSION_1_1) {
+        cout << "Error: -k cannot be combined with -H 2 or 2c" << endl;
+        return EXIT_FAILURE;
+    }
+    if (requests_per_connection_ > 0 && max_connections_ > 0) {
+        cout << "Error: -k cannot be combined with -M" << endl;
+        return EXIT_FAILURE;
+    }
+    if (max_streams_ > 0 && curl_http_version_ == CURL_HTTP_VERSION_1_1) {
+        cout << "Error: -m needs -H 2 or 2c, an HTTP/1.1 connection has a single stream" << endl;
+        return EXIT_FAILURE;
     }
 
     // Construct request body from stdin
-    if (IsStdinAvailable()) {
+    if (workload_filename_.empty() && replay_filename_.empty() && read_stdin_ && IsStdinAvailable()) {
         request_body_ = "";
         for (string str_line; getline(cin, str_line);) {
             request_body_.append(str_line);
             request_body_.append("\n");
         }
     }
+
+    // The body is a document template in the bulk mode, which has to be a single line of NDJSON
+    if (bulk_docs_ > 0) {
+        request_body_.erase(remove_if(request_body_.begin(), request_body_.end(),
+                                      [](char c) { return c == '\n' || c == '\r'; }), request_body_.end());
+        if (http_method_ == "GET") http_method_ = "POST";
+    }
+
+    // Load the queries, a path in the workload file is relative to the URL
+    if (!workload_filename_.empty()) {
+        string error;
+        if (!workload_.Load(workload_filename_, http_method_, request_url_, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    } else {
+        workload_.AddQuery("default", http_method_, request_url_, request_body_, 1.0);
+    }
+
+    // Compile the URLs and the bodies once, workers only render them
+    workload_.Compile(&dict_);
+    if (gzip_request_ && bulk_docs_ == 0) {
+        string error;
+        if (!workload_.Precompress(&error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Threads for the busiest stage are started, the others pause while the stage runs fewer
+    if (!stages_filename_.empty()) {
+        string error;
+        if (!Profile::Load(stages_filename_, num_threads_, request_rate_, &stages_, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+        double total_sec = 0;
+        for (const Stage &stage : stages_) {
+            num_threads_ = max(num_threads_, stage.threads);
+            request_rate_ = max(request_rate_, stage.rate);
+            total_sec += stage.duration_sec;
+        }
+        if (duration_sec_ <= 0) duration_sec_ = total_sec;
+    }
+
+    // The log sets the times and the requests, so that neither a rate nor a mix of queries applies
+    if (!replay_filename_.empty()) {
+        if (request_rate_ > 0 || bulk_docs_ > 0 || !workload_filename_.empty()) {
+            cout << "Error: -P cannot be combined with -R, stage rates, -B or -f" << endl;
+            return EXIT_FAILURE;
+        }
+        string error;
+        if (!replay_.Open(replay_filename_, http_method_, request_url_, replay_speed_, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The CPUs are those of the machine running the workers, so an agent checks them for itself
+    for (auto cpus : {make_pair(&worker_cpus_spec_, &worker_cpus_), make_pair(&timer_cpus_spec_, &timer_cpus_)}) {
+        if (cpus.first->empty() || !agents_.empty()) continue;
+        string error;
+        if (!Affinity::IsSupported()) {
+            cout << "Error: CPU pinning is only supported on Linux" << endl;
+            return EXIT_FAILURE;
+        }
+        if (!Affinity::Parse(*cpus.first, cpus.second, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The search moves the level itself, by the threads or from the rate given
+    if (!objective_.empty()) {
+        vector<pair<string, double>> limits;
+        string error;
+        if (!Search::ParseObjective(objective_, &limits, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+        if (!stages_.empty() || replay_.IsOpen() || !agents_.empty()) {
+            cout << "Error: -Q cannot be combined with -S, -P or -W" << endl;
+            return EXIT_FAILURE;
+        }
+        if (probe_sec_ <= 0) {
+            cout << "Error: probe seconds must be positive" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!retry_spec_.empty()) {
+        string error;
+        if (!retry_.Parse(retry_spec_, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // A timed run goes on until the time is up, a replay until the log is done and a search until it has found the
+    // capacity, unless the recurrence is given
+    if ((duration_sec_ > 0 || replay_.IsOpen() || !objective_.empty()) && !recurrence_specified_) {
+        num_recurrence_ = numeric_limits<u_int>::max();
+    }
+
+    if (!output_filename_.empty()) {
+        string error;
+        if (!report_.Open(output_filename_, output_format_, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The requests are logged where the workers run, so each agent opens a log of its own in Share
+    if (!log_sampling_.empty() || !log_filename_.empty()) {
+        string error;
+        if (!logger_.ParseSampling(log_sampling_, &error) ||
+            (!log_filename_.empty() && agents_.empty() && !agent_ && !logger_.Open(log_filename_, num_threads_, &error))) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (thresholds_specified_ && baseline_filename_.empty()) {
+        cout << "Error: -G needs a baseline to compare with (-C)" << endl;
+        return EXIT_FAILURE;
+    }
+    if (!baseline_filename_.empty()) {
+        string error;
+        if (!baseline_.Load(baseline_filename_, &error) || !baseline_.SetThresholds(thresholds_, &error)) {
+            cout << "Error: " << error << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Pick a seed to report when not specified, so that the run can be repeated
+    if (!seed_specified_) {
+        random_device rd;
+        seed_ = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
     return EXIT_SUCCESS;
 }
 
+bool Options::Share(const u_int index, const u_int count, string *error) {
+    seed_ += static_cast<uint64_t>(index) * num_threads_;
+    request_rate_ /= count;
+    for (Stage &stage : stages_) {
+        stage.from_rate /= count;
+        stage.rate /= count;
+    }
+    if (replay_.IsOpen()) replay_.SetPart(index, count);
+    agent_ = true;
+    if (!log_filename_.empty()) {
+        log_filename_ += "." + to_string(index);
+        if (!logger_.Open(log_filename_, num_threads_, error)) return false;
+    }
+    return true;
+}
+
+bool Options::IsOpenLoop() const {
+    return request_rate_ > 0 || replay_.IsOpen();
+}
+
 void Options::PrintLine(const string otion, const u_int value)
 {
     cout << setw(35) << right << otion << ": " << setw(15) << right << value << endl;
@@ -94,21 +413,132 @@ void Options::PrintLine(const string otion, const bool value)
     }
 }
 
+void Options::PrintLine(const string otion, const uint64_t value)
+{
+    cout << setw(35) << right << otion << ": " << setw(15) << right << value << endl;
+}
+
+void Options::PrintLine(const string otion, const double value)
+{
+    cout << setw(35) << right << otion << ": " << setw(15) << right << value << endl;
+}
+
 // Print parsed options
 void Options::Print()
 {
     cout << OPTIONS_HEADER << endl;
     PrintLine("Number of threads", num_threads_);
-    PrintLine("Number of recurrence", num_recurrence_);
+    PrintLine("Connections per thread", num_connections_);
+    PrintLine("HTTP version", http_version_);
+    if (max_streams_ > 0) PrintLine("Streams per connection", max_streams_);
+    if (max_connections_ > 0) PrintLine("Maximum pooled connections", max_connections_);
+    if (requests_per_connection_ > 0) PrintLine("Requests per connection", requests_per_connection_);
+    PrintLine("TCP_NODELAY", tcp_nodelay_);
+    PrintLine("gzip request", gzip_request_);
+    PrintLine("Accept-Encoding", accept_encoding_);
+    if (bulk_docs_ > 0) PrintLine("Documents per request", bulk_docs_);
+    if (num_recurrence_ == numeric_limits<u_int>::max()) {
+        PrintLine("Number of recurrence", string("unlimited"));
+    } else {
+        PrintLine("Number of recurrence", num_recurrence_);
+    }
+    if (duration_sec_ > 0) PrintLine("Duration (sec)", duration_sec_);
+    if (!stages_.empty()) {
+        PrintLine("Stages", stages_filename_);
+        PrintLine("Number of stages", static_cast<u_int>(stages_.size()));
+    }
+    if (request_rate_ > 0) PrintLine("Requests per second", request_rate_);
+    if (!objective_.empty()) {
+        PrintLine("Objective", objective_);
+        PrintLine("Probe (sec)", probe_sec_);
+    }
+    if (retry_.IsEnabled()) PrintLine("Retry policy", retry_spec_);
+    if (replay_.IsOpen()) {
+        PrintLine("Replay", replay_filename_);
+        PrintLine("Replay speed", replay_speed_);
+    }
+    if (!worker_cpus_spec_.empty()) PrintLine("Worker CPUs", worker_cpus_spec_);
+    if (!timer_cpus_spec_.empty()) PrintLine("Timer CPUs", timer_cpus_spec_);
+    if (metrics_port_ > 0) PrintLine("Metrics address", metrics_host_ + ":" + to_string(metrics_port_));
     PrintLine("Interval (sec)", interval_sec_);
     PrintLine("Warm-up (sec)", warmup_sec_);
     PrintLine("Timeout (sec)", timeout_sec_);
     PrintLine("Dictionary", dict_filename_);
+    if (dict_.Size() > 0) {
+        PrintLine("Dictionary terms", static_cast<uint64_t>(dict_.Size()));
+        PrintLine("Dictionary distribution", dict_.DistributionName());
+    }
+    PrintLine("Random seed", seed_);
     PrintLine("URL", request_url_);
+    if (!nodes_.empty()) {
+        for (const string &node : nodes_) PrintLine("Node", node);
+        PrintLine("Balance", Balancer::PolicyName(balance_policy_));
+    }
     PrintLine("HTTP Method", http_method_);
+    for (const string &agent : agents_) PrintLine("Agent", agent);
+    if (!output_filename_.empty()) PrintLine("Output", output_filename_);
+    if (!log_filename_.empty()) {
+        PrintLine("Request log", log_filename_);
+        if (!log_sampling_.empty()) PrintLine("Log sampling", log_sampling_);
+    }
+    if (!baseline_filename_.empty()) {
+        PrintLine("Baseline", baseline_filename_);
+        PrintLine("Thresholds (%)", thresholds_);
+    }
     if (verbose_) PrintLine("HTTP User", http_user_);
     if (verbose_) PrintLine("Verbose", verbose_);
-    PrintLine("Body", request_body_);
+    if (!workload_filename_.empty()) {
+        PrintLine("Workload", workload_filename_);
+        PrintLine("Number of queries", static_cast<u_int>(workload_.Size()));
+    } else {
+        PrintLine("Body", request_body_);
+    }
+}
+
+void Options::Export(Record *record) const {
+    record->Add("threads", static_cast<u_long>(num_threads_));
+    record->Add("connections", static_cast<u_long>(num_connections_));
+    record->Add("http_version", http_version_);
+    record->Add("max_streams", static_cast<u_long>(max_streams_));
+    record->Add("max_connections", static_cast<u_long>(max_connections_));
+    record->Add("requests_per_connection", static_cast<u_long>(requests_per_connection_));
+    record->Add("tcp_nodelay", string(tcp_nodelay_ ? "true" : "false"));
+    record->Add("gzip_request", string(gzip_request_ ? "true" : "false"));
+    record->Add("accept_encoding", string(accept_encoding_ ? "true" : "false"));
+    record->Add("recurrence", static_cast<u_long>(num_recurrence_));
+    record->Add("duration_sec", duration_sec_);
+    record->Add("request_rate", request_rate_);
+    record->Add("objective", objective_);
+    record->Add("probe_sec", probe_sec_);
+    record->Add("retry_policy", retry_spec_);
+    record->Add("request_log", log_filename_);
+    record->Add("log_sampling", log_sampling_);
+    record->Add("replay", replay_filename_);
+    record->Add("replay_speed", replay_speed_);
+    record->Add("bulk_docs", static_cast<u_long>(bulk_docs_));
+    record->Add("worker_cpus", worker_cpus_spec_);
+    record->Add("timer_cpus", timer_cpus_spec_);
+    record->Add("metrics_host", metrics_host_);
+    record->Add("metrics_port", static_cast<u_long>(metrics_port_));
+    record->Add("interval_sec", static_cast<u_long>(interval_sec_));
+    record->Add("warm_up_sec", static_cast<u_long>(warmup_sec_));
+    record->Add("timeout_sec", static_cast<u_long>(timeout_sec_));
+    record->Add("dictionary", dict_filename_);
+    record->Add("dictionary_distribution", dict_.DistributionName());
+    record->Add("seed", to_string(seed_));
+    record->Add("url", request_url_);
+    record->Add("method", http_method_);
+    record->Add("workload", workload_filename_);
+    record->Add("queries", static_cast<u_long>(workload_.Size()));
+    string nodes;
+    for (const string &node : nodes_) nodes += (nodes.empty() ? "" : ",") + node;
+    record->Add("nodes", nodes);
+    record->Add("balance", Balancer::PolicyName(balance_policy_));
+    record->Add("stages", stages_filename_);
+    string agents;
+    for (const string &agent : agents_) agents += (agents.empty() ? "" : ",") + agent;
+    record->Add("agents", agents);
+    record->Add("baseline", baseline_filename_);
 }
 
 // Check if any standard input is available
@@ -10,25 +10,117 @@
 #include <fstream>
 #include <unistd.h>
 #include <sys/poll.h>
+#include <algorithm>
 #include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
 #include <vector>
 
+#include "Workload.h"
+#include "Balancer.h"
+#include "Profile.h"
+#include "Report.h"
+#include "Baseline.h"
+#include "Replay.h"
+#include "Affinity.h"
+#include "Retry.h"
+#include "Logger.h"
+
 using namespace std;
 
 class Options {
 public:
     u_int num_threads_ = 1;
     u_int num_recurrence_ = 1;
+    bool recurrence_specified_ = false;
+    // Seconds to run, 0 runs until the recurrence is done
+    double duration_sec_ = 0;
+    // Stages of the load level over the run
+    string stages_filename_;
+    vector<Stage> stages_;
+    // Concurrent requests per thread, more than 1 drives them with curl_multi
+    u_int num_connections_ = 1;
+    // HTTP version of curl, 1.1, 2 over TLS or 2c with prior knowledge
+    string http_version_ = "1.1";
+    long curl_http_version_ = CURL_HTTP_VERSION_1_1;
+    // Concurrent HTTP/2 streams per connection, 0 keeps the curl default
+    u_int max_streams_ = 0;
+    // Connections each thread keeps open at most, 0 for as many as the requests need
+    u_int max_connections_ = 0;
+    // Close a connection after this many requests, 0 keeps it alive
+    u_int requests_per_connection_ = 0;
+    bool tcp_nodelay_ = true;
+    // Send the bodies with Content-Encoding: gzip, and accept compressed responses
+    bool gzip_request_ = false;
+    bool accept_encoding_ = false;
+    // Documents streamed in each _bulk request, 0 sends the body as it is
+    u_int bulk_docs_ = 0;
+    // Requests per second over all threads, 0 keeps the closed-loop mode
+    double request_rate_ = 0;
+    // Search for the highest level meeting the objective, each probe running probe_sec_
+    string objective_;
+    double probe_sec_ = 30;
+    // Retries of the requests pushed back on, with their backoff and budget
+    string retry_spec_;
+    RetryPolicy retry_;
+    // Log of requests sent again at their logged times, replay_speed_ times as fast
+    string replay_filename_;
+    double replay_speed_ = 1.0;
+    Replay replay_;
+    // CPUs the workers are pinned to one each in turn, and the CPUs of the timer, empty leaves them to the scheduler
+    string worker_cpus_spec_;
+    vector<u_int> worker_cpus_;
+    string timer_cpus_spec_;
+    vector<u_int> timer_cpus_;
     u_int interval_sec_ = 1;
-    u_int warmup_sec_;
-    u_int timeout_sec_;
-    vector<string> dict_;
+    u_int warmup_sec_ = 0;
+    u_int timeout_sec_ = 0;
+    Dictionary dict_;
     string dict_filename_;
+    // Distribution of $RDICT terms
+    string dict_distribution_ = "uniform";
     string http_method_ = "GET";
     string http_user_;
     string request_body_;
     string request_url_;
+    // Base URLs of the nodes to spread the requests over, in place of the host of request_url_
+    vector<string> nodes_;
+    Balancer::Policy balance_policy_ = Balancer::ROUND_ROBIN;
+    // Queries to perform, request_url_ and request_body_ unless a workload file is given
+    string workload_filename_;
+    Workload workload_;
+    // Seed of the per-thread random number generators
+    uint64_t seed_;
+    bool seed_specified_ = false;
     bool verbose_ = false;
+    // Address and port to serve the live counters on for Prometheus, the loopback unless given, port 0 for none
+    string metrics_host_;
+    u_int metrics_port_ = 0;
+    // Intervals and results written for machines as well
+    string output_filename_;
+    Report::Format output_format_ = Report::JSON_LINES;
+    Report report_;
+    // Requests sampled into a log written off the hot path, by the sampling given
+    string log_filename_;
+    string log_sampling_;
+    Logger logger_;
+    // Results of a previous run to check this one against
+    string baseline_filename_;
+    string thresholds_ = "requests_per_sec=5,latency_p99=10";
+    bool thresholds_specified_ = false;
+    Baseline baseline_;
+    // Agents to coordinate as host:port, each running the threads and the recurrence given
+    vector<string> agents_;
+    // Address and port to wait for a coordinator on, as an agent, the loopback unless given
+    string agent_host_;
+    u_int agent_port_ = 0;
+    // Running for a coordinator, which shows the progress and the results
+    bool agent_ = false;
+    // Options in the order given, handed over to the agents
+    vector<pair<char, string>> arguments_;
+    // The body comes from stdin, unless a coordinator has handed it over
+    bool read_stdin_ = true;
     // timeout msec to check if stdin is available
     u_int poll_timeout = 100;
 
@@ -36,6 +128,17 @@ public:
 
     void Print();
 
+    // Requests are sent at the times of a schedule, a rate or the log replayed, rather than after the previous one
+    bool IsOpenLoop() const;
+
+    // Take the part of the load of the agent at index out of count, the rates are split evenly and the random
+    // number streams follow on from those of the earlier agents. The request log of the agent is named after its
+    // index, so that agents on the same host do not write over each other
+    bool Share(const u_int index, const u_int count, string *error);
+
+    // Put the options into a record of the report
+    void Export(Record *record) const;
+
 private:
     bool IsStdinAvailable();
 
@@ -44,6 +147,10 @@ private:
     void PrintLine(const string otion, const string value);
 
     void PrintLine(const string otion, const bool value);
+
+    void PrintLine(const string otion, const uint64_t value);
+
+    void PrintLine(const string otion, const double value);
 };
 
 #endif //ESPERF_OPTIONS_H
@@ -0,0 +1,142 @@
+//
+// Load level changing over the stages of a run
+//
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+
+#include "Profile.h"
+#include "Json.h"
+
+// Period to move the level during a ramp
+static const double RAMP_STEP_SEC = 0.1;
+
+bool Profile::Load(const string &filename, const u_int threads, const double rate, vector<Stage> *stages,
+                   string *error) {
+    ifstream if_stages(filename);
+    if (!if_stages) {
+        *error = "cannot open " + filename;
+        return false;
+    }
+
+    u_int prev_threads = threads;
+    double prev_rate = rate;
+    int line_number = 0;
+    for (string str_line; getline(if_stages, str_line);) {
+        line_number++;
+        if (str_line.find_first_not_of(" \t\r") == string::npos) continue;
+
+        map<string, JsonValue> members;
+        string parse_error;
+        if (!Json::ParseObject(str_line, &members, &parse_error)) {
+            *error = filename + ":" + to_string(line_number) + ": " + parse_error;
+            return false;
+        }
+
+        Stage stage;
+        stage.label = members.count("label") ? members["label"].text : "stage" + to_string(stages->size() + 1);
+        stage.duration_sec = members.count("duration") ? atof(members["duration"].text.c_str()) : 0.0;
+        stage.from_threads = prev_threads;
+        stage.from_rate = prev_rate;
+        stage.threads = members.count("threads") ? static_cast<u_int>(atoi(members["threads"].text.c_str()))
+                                                 : prev_threads;
+        stage.rate = members.count("rate") ? atof(members["rate"].text.c_str()) : prev_rate;
+        stage.ramp = members.count("ramp") && members["ramp"].text == "true";
+        if (stage.duration_sec <= 0) {
+            *error = filename + ":" + to_string(line_number) + ": duration must be positive";
+            return false;
+        }
+        if (stage.threads < 1) {
+            *error = filename + ":" + to_string(line_number) + ": threads must be positive";
+            return false;
+        }
+        stages->push_back(stage);
+        prev_threads = stage.threads;
+        prev_rate = stage.rate;
+    }
+
+    if (stages->empty()) {
+        *error = filename + ": no stages";
+        return false;
+    }
+
+    // Every stage sends at a rate once any does, the closed-loop mode has no rate to move to
+    bool open_loop = false;
+    for (const Stage &stage : *stages) open_loop = open_loop || stage.rate > 0;
+    for (const Stage &stage : *stages) {
+        if (open_loop && (stage.rate <= 0 || (stage.ramp && stage.from_rate <= 0))) {
+            *error = filename + ": stage " + stage.label + " has no rate, give it from the first stage or with -R";
+            return false;
+        }
+    }
+    return true;
+}
+
+Profile::Profile(const vector<Stage> &stages, const u_int threads, const double rate) : stages_(stages),
+                                                                                       active_threads_(threads),
+                                                                                       rate_(rate) {
+    double end = 0.0;
+    for (const Stage &stage : stages_) {
+        end += stage.duration_sec;
+        ends_.push_back(end);
+    }
+    Update(0.0);
+}
+
+size_t Profile::Update(const double elapsed_sec) {
+    size_t index = 0;
+    while (index < ends_.size() && elapsed_sec >= ends_[index]) index++;
+    // The level of the last stage stays after it
+    if (index == ends_.size()) {
+        if (!stages_.empty()) SetLevel(stages_.back().threads, stages_.back().rate);
+        return index;
+    }
+
+    const Stage &stage = stages_[index];
+    if (!stage.ramp) {
+        SetLevel(stage.threads, stage.rate);
+        return index;
+    }
+    double progress = 1.0 - (ends_[index] - elapsed_sec) / stage.duration_sec;
+    double threads = stage.from_threads + (static_cast<double>(stage.threads) - stage.from_threads) * progress;
+    double rate = stage.from_rate + (stage.rate - stage.from_rate) * progress;
+    SetLevel(max(1U, static_cast<u_int>(lround(threads))), rate);
+    return index;
+}
+
+double Profile::NextChange(const double elapsed_sec) const {
+    for (size_t i = 0; i < ends_.size(); i++) {
+        if (elapsed_sec >= ends_[i]) continue;
+        if (stages_[i].ramp) return min(ends_[i], elapsed_sec + RAMP_STEP_SEC);
+        return ends_[i];
+    }
+    return -1.0;
+}
+
+void Profile::Set(const u_int threads, const double rate) {
+    SetLevel(threads, rate);
+}
+
+u_int Profile::ActiveThreads() const {
+    return active_threads_.load(memory_order_acquire);
+}
+
+double Profile::Rate() const {
+    return rate_.load(memory_order_acquire);
+}
+
+u_long Profile::Generation() const {
+    return generation_.load(memory_order_acquire);
+}
+
+void Profile::SetLevel(const u_int threads, const double rate) {
+    if (generation_.load(memory_order_relaxed) > 0 && threads == active_threads_.load(memory_order_relaxed) &&
+        rate == rate_.load(memory_order_relaxed)) {
+        return;
+    }
+    active_threads_.store(threads, memory_order_release);
+    rate_.store(rate, memory_order_release);
+    generation_.fetch_add(1, memory_order_release);
+}
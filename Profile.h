@@ -0,0 +1,66 @@
+//
+// Load level changing over the stages of a run
+//
+
+#ifndef ESPERF_PROFILE_H
+#define ESPERF_PROFILE_H
+
+#include <atomic>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+using namespace std;
+
+struct Stage {
+    string label;
+    double duration_sec = 0.0;
+    // Total threads and requests per second at the start and the end of the stage
+    u_int from_threads = 1;
+    double from_rate = 0.0;
+    u_int threads = 1;
+    double rate = 0.0;
+    // Move linearly from the start level to the end one, otherwise step to the end level at once
+    bool ramp = false;
+};
+
+class Profile {
+public:
+    // Read NDJSON lines of {"label", "duration", "threads", "rate", "ramp"}, an omitted level carries over from
+    // the previous stage, the first one from threads and rate
+    static bool Load(const string &filename, const u_int threads, const double rate, vector<Stage> *stages,
+                     string *error);
+
+    // Without stages the level stays at threads and rate
+    Profile(const vector<Stage> &stages, const u_int threads, const double rate);
+
+    // Set the level for elapsed seconds from the start, return the index of the stage, the number of stages after
+    // the last one
+    size_t Update(const double elapsed_sec);
+
+    // Elapsed seconds at which the level changes next, negative if it never does
+    double NextChange(const double elapsed_sec) const;
+
+    // Hold the level given, such as by the search, in place of the stages
+    void Set(const u_int threads, const double rate);
+
+    u_int ActiveThreads() const;
+
+    double Rate() const;
+
+    // Incremented on every change of the level
+    u_long Generation() const;
+
+private:
+    vector<Stage> stages_;
+    // Elapsed seconds at the end of every stage
+    vector<double> ends_;
+
+    atomic<u_int> active_threads_;
+    atomic<double> rate_;
+    atomic<u_long> generation_{0};
+
+    void SetLevel(const u_int threads, const double rate);
+};
+
+#endif //ESPERF_PROFILE_H
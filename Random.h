@@ -0,0 +1,55 @@
+//
+// Fast per-thread pseudo random number generator (xoshiro256**)
+//
+
+#ifndef ESPERF_RANDOM_H
+#define ESPERF_RANDOM_H
+
+#include <cstdint>
+
+class Random {
+public:
+    explicit Random(uint64_t seed = 0) { Seed(seed); }
+
+    // Expand a single 64 bit seed to the whole state with splitmix64
+    void Seed(uint64_t seed) {
+        for (int i = 0; i < 4; i++) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            s_[i] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t Next() {
+        const uint64_t result = Rotl(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = Rotl(s_[3], 45);
+        return result;
+    }
+
+    // Random number in [0, n), n must be greater than 0
+    uint64_t Uniform(uint64_t n) {
+        return Next() % n;
+    }
+
+    // Random number in [0, 1)
+    double NextDouble() {
+        return (Next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    uint64_t s_[4];
+
+    static uint64_t Rotl(const uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+#endif //ESPERF_RANDOM_H
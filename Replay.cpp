@@ -0,0 +1,205 @@
+//
+// Captured requests sent again on the timeline of the log
+//
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "Replay.h"
+
+Replay::~Replay() {
+    Stop();
+    if (reader_.joinable()) reader_.join();
+}
+
+bool Replay::Open(const string &filename, const string &default_method, const string &base_url, const double speed,
+                  string *error) {
+    filename_ = filename;
+    default_method_ = default_method;
+    // Paths are appended to the scheme, host and port
+    base_url_ = base_url.substr(0, base_url.find('/', base_url.find("://") + 3));
+    if (speed <= 0) {
+        *error = "replay speed must be positive";
+        return false;
+    }
+    speed_ = speed;
+
+    file_.open(filename);
+    if (!file_) {
+        *error = "cannot open " + filename;
+        return false;
+    }
+
+    // Only the first request is checked here, the rest are read while they are sent
+    int line_number = 0;
+    for (string line; getline(file_, line);) {
+        line_number++;
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        Entry entry;
+        int64_t timestamp_usec;
+        if (!ParseLine(line, &entry, &timestamp_usec)) {
+            *error = filename + ":" + to_string(line_number) + ": needs a timestamp and a url, path or index";
+            return false;
+        }
+        break;
+    }
+    file_.clear();
+    file_.seekg(0);
+    return true;
+}
+
+bool Replay::IsOpen() const {
+    return file_.is_open();
+}
+
+void Replay::SetPart(const u_int index, const u_int count) {
+    part_index_ = index;
+    part_count_ = count;
+}
+
+void Replay::Start(chrono::steady_clock::time_point start) {
+    reader_ = thread(&Replay::Read, this, start);
+}
+
+bool Replay::Take(Entry *entry) {
+    unique_lock<mutex> lock(mtx_);
+    cv_not_empty_.wait(lock, [this] { return !queue_.empty() || done_ || stopped_; });
+    if (queue_.empty() || stopped_) return false;
+    *entry = move(queue_.front());
+    queue_.pop_front();
+    cv_not_full_.notify_one();
+    return true;
+}
+
+void Replay::Stop() {
+    lock_guard<mutex> lock(mtx_);
+    stopped_ = true;
+    cv_not_empty_.notify_all();
+    cv_not_full_.notify_all();
+}
+
+u_long Replay::Skipped() {
+    lock_guard<mutex> lock(mtx_);
+    return skipped_;
+}
+
+const string &Replay::Filename() const {
+    return filename_;
+}
+
+double Replay::Speed() const {
+    return speed_;
+}
+
+// Keep the queue filled up to its capacity, every part keeps the timeline of the whole log
+void Replay::Read(chrono::steady_clock::time_point start) {
+    bool has_first = false;
+    int64_t first_usec = 0;
+    u_long index = 0;
+    for (string line; getline(file_, line);) {
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        Entry entry;
+        int64_t timestamp_usec;
+        if (!ParseLine(line, &entry, &timestamp_usec)) {
+            lock_guard<mutex> lock(mtx_);
+            skipped_++;
+            continue;
+        }
+        if (!has_first) {
+            first_usec = timestamp_usec;
+            has_first = true;
+        }
+        if (index++ % part_count_ != part_index_) continue;
+
+        // A request logged before the first one is due at once, and counted late
+        chrono::duration<double, micro> offset((timestamp_usec - first_usec) / speed_);
+        entry.due = start + chrono::duration_cast<chrono::steady_clock::duration>(offset);
+
+        unique_lock<mutex> lock(mtx_);
+        cv_not_full_.wait(lock, [this] { return queue_.size() < QUEUE_CAPACITY || stopped_; });
+        if (stopped_) break;
+        queue_.push_back(move(entry));
+        cv_not_empty_.notify_one();
+    }
+    lock_guard<mutex> lock(mtx_);
+    done_ = true;
+    cv_not_empty_.notify_all();
+}
+
+bool Replay::ParseLine(const string &line, Entry *entry, int64_t *timestamp_usec) const {
+    map<string, JsonValue> members;
+    string parse_error;
+    if (!Json::ParseObject(line, &members, &parse_error)) return false;
+
+    const char *timestamp = members.count("timestamp") ? "timestamp" : "@timestamp";
+    if (!members.count(timestamp) || !ParseTimestamp(members[timestamp], timestamp_usec)) return false;
+
+    // Elasticsearch JSON slow logs name the index and the source of the search
+    string index;
+    for (const char *name : {"index", "elasticsearch.index.name"}) {
+        if (members.count(name)) index = members[name].text;
+    }
+    if (members.count("url")) {
+        entry->url = members["url"].text;
+    } else if (members.count("path")) {
+        const string &path = members["path"].text;
+        entry->url = base_url_ + (path.empty() || path[0] != '/' ? "/" : "") + path;
+    } else if (!index.empty()) {
+        entry->url = base_url_ + "/" + index + "/_search";
+    } else {
+        return false;
+    }
+
+    entry->method = members.count("method") ? members["method"].text : default_method_;
+    entry->body.clear();
+    for (const char *name : {"body", "source", "elasticsearch.slowlog.source"}) {
+        if (members.count(name) && members[name].type != JsonValue::NIL) entry->body = members[name].text;
+    }
+    return true;
+}
+
+bool Replay::ParseTimestamp(const JsonValue &value, int64_t *timestamp_usec) {
+    if (value.type == JsonValue::NUMBER) {
+        double number = atof(value.text.c_str());
+        // Seconds would not reach 1e11 until the year 5138, so larger numbers are msec
+        if (number > 1e11) number /= 1000.0;
+        *timestamp_usec = static_cast<int64_t>(number * 1000000.0);
+        return true;
+    }
+    if (value.type != JsonValue::STRING) return false;
+
+    // 2024-05-01T12:00:00.123+09:00, the fraction and the offset are optional and a space may replace the T
+    const string &text = value.text;
+    struct tm tm = {};
+    int consumed = 0;
+    if (sscanf(text.c_str(), "%4d-%2d-%2d%*1[T ]%2d:%2d:%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+               &tm.tm_min, &tm.tm_sec, &consumed) != 6 || consumed == 0) {
+        return false;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    int64_t usec = static_cast<int64_t>(timegm(&tm)) * 1000000;
+
+    size_t pos = static_cast<size_t>(consumed);
+    if (pos < text.size() && (text[pos] == '.' || text[pos] == ',')) {
+        int64_t scale = 100000;
+        for (pos++; pos < text.size() && isdigit(static_cast<unsigned char>(text[pos])); pos++) {
+            usec += (text[pos] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+        int hours = 0;
+        int minutes = 0;
+        if (sscanf(text.c_str() + pos + 1, "%2d:%2d", &hours, &minutes) != 2) {
+            minutes = 0;
+            if (sscanf(text.c_str() + pos + 1, "%2d%2d", &hours, &minutes) < 1) return false;
+        }
+        int64_t offset = (hours * 3600 + minutes * 60) * static_cast<int64_t>(1000000);
+        usec += text[pos] == '+' ? -offset : offset;
+    }
+    *timestamp_usec = usec;
+    return true;
+}
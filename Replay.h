@@ -0,0 +1,89 @@
+//
+// Captured requests sent again on the timeline of the log
+//
+
+#ifndef ESPERF_REPLAY_H
+#define ESPERF_REPLAY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Json.h"
+
+using namespace std;
+
+class Replay {
+public:
+    // Request of the log, with the time it is due in the run
+    struct Entry {
+        chrono::steady_clock::time_point due;
+        string method;
+        string url;
+        string body;
+    };
+
+    ~Replay();
+
+    // Check the log can be read, its NDJSON lines are {"timestamp" or "@timestamp", "method", "url" or "path",
+    // "body" or "source"}, a path is appended to base_url, and an "index" alone searches it as a slow log does.
+    // The timeline runs speed times as fast as the log
+    bool Open(const string &filename, const string &default_method, const string &base_url, const double speed,
+              string *error);
+
+    bool IsOpen() const;
+
+    // Replay only every count-th request from index on, so that agents share the log
+    void SetPart(const u_int index, const u_int count);
+
+    // Read ahead in a thread of its own, the first request of the log is due at start
+    void Start(chrono::steady_clock::time_point start);
+
+    // Take the next request in the order of the log, false once the log is done or the run is stopped
+    bool Take(Entry *entry);
+
+    void Stop();
+
+    // Lines which could not be read, such as without a timestamp
+    u_long Skipped();
+
+    const string &Filename() const;
+
+    double Speed() const;
+
+private:
+    // Requests read ahead at most, so that a large log is streamed rather than held
+    static const size_t QUEUE_CAPACITY = 4096;
+
+    string filename_;
+    string default_method_;
+    string base_url_;
+    double speed_ = 1.0;
+    u_int part_index_ = 0;
+    u_int part_count_ = 1;
+
+    ifstream file_;
+    thread reader_;
+    mutex mtx_;
+    condition_variable cv_not_empty_;
+    condition_variable cv_not_full_;
+    deque<Entry> queue_;
+    bool done_ = false;
+    bool stopped_ = false;
+    u_long skipped_ = 0;
+
+    void Read(chrono::steady_clock::time_point start);
+
+    // Fill the entry from a line, with the timestamp in usec since the epoch
+    bool ParseLine(const string &line, Entry *entry, int64_t *timestamp_usec) const;
+
+    // Seconds or msec since the epoch, or an ISO 8601 date and time
+    static bool ParseTimestamp(const JsonValue &value, int64_t *timestamp_usec);
+};
+
+#endif //ESPERF_REPLAY_H
@@ -0,0 +1,133 @@
+//
+// Machine-readable output of a run, JSON lines or CSV
+//
+
+#include <cstdlib>
+#include <sstream>
+
+#include "Report.h"
+#include "Json.h"
+
+// Columns of a CSV file, the fields of a record without a column are left out
+static const char *CSV_COLUMNS[] = {"type", "timestamp", "label", "elapsed_sec", "success", "error_curl",
+                                    "error_http", "error_partial", "requests_per_sec", "upload_bytes_per_sec",
+                                    "download_bytes_per_sec", "upload_decoded_bytes_per_sec",
+                                    "download_decoded_bytes_per_sec", "docs_per_sec", "latency_avg", "latency_p50",
+                                    "latency_p90", "latency_p99", "latency_p99_9", "latency_max", "took_avg",
+                                    "behind_schedule", "new_connections", "lookup_avg", "lookup_p99",
+                                    "connect_avg", "connect_p99", "tls_avg", "tls_p99", "pretransfer_avg",
+                                    "pretransfer_p99", "ttfb_avg", "ttfb_p99", "download_avg", "download_p99",
+                                    "value"};
+
+Record::Record(const string &type) : type_(type) {}
+
+void Record::Add(const string &name, const string &value) {
+    fields_.push_back(Field{name, value, true});
+}
+
+void Record::Add(const string &name, const double value) {
+    stringstream text;
+    text.precision(9);
+    text << value;
+    fields_.push_back(Field{name, text.str(), false});
+}
+
+void Record::Add(const string &name, const u_long value) {
+    fields_.push_back(Field{name, to_string(value), false});
+}
+
+bool Record::Number(const string &name, double *value) const {
+    for (const Field &field : fields_) {
+        if (field.name == name && !field.quoted) {
+            *value = atof(field.text.c_str());
+            return true;
+        }
+    }
+    return false;
+}
+
+const string &Record::Type() const {
+    return type_;
+}
+
+bool Report::ParseFormat(const string &name, Format *format) {
+    if (name == "jsonl") {
+        *format = JSON_LINES;
+    } else if (name == "csv") {
+        *format = CSV;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool Report::Open(const string &filename, const Format format, string *error) {
+    out_.open(filename, ios::out | ios::trunc);
+    if (!out_) {
+        *error = "cannot open " + filename;
+        return false;
+    }
+    format_ = format;
+    if (format_ == CSV) {
+        for (size_t i = 0; i < sizeof(CSV_COLUMNS) / sizeof(CSV_COLUMNS[0]); i++) {
+            out_ << (i > 0 ? "," : "") << CSV_COLUMNS[i];
+        }
+        out_ << endl;
+    }
+    return true;
+}
+
+bool Report::IsOpen() const {
+    return out_.is_open();
+}
+
+void Report::Write(const Record &record) {
+    if (!out_.is_open()) return;
+
+    if (format_ == JSON_LINES) {
+        out_ << "{\"type\":" << Json::Quote(record.type_);
+        for (const Record::Field &field : record.fields_) {
+            out_ << "," << Json::Quote(field.name) << ":" << (field.quoted ? Json::Quote(field.text) : field.text);
+        }
+        out_ << "}" << endl;
+        return;
+    }
+
+    // The options do not fit the columns, so they are written a row for each, with the name in label
+    if (record.type_ == "options") {
+        for (const Record::Field &field : record.fields_) {
+            out_ << "option";
+            for (const char *column : CSV_COLUMNS) {
+                string name = column;
+                if (name == "type") continue;
+                out_ << "," << (name == "label" ? CsvField(field.name) : name == "value" ? CsvField(field.text) : "");
+            }
+            out_ << endl;
+        }
+        return;
+    }
+
+    out_ << CsvField(record.type_);
+    for (const char *column : CSV_COLUMNS) {
+        if (string(column) == "type") continue;
+        out_ << ",";
+        for (const Record::Field &field : record.fields_) {
+            if (field.name == column) {
+                out_ << CsvField(field.text);
+                break;
+            }
+        }
+    }
+    out_ << endl;
+}
+
+// Quote a field which has a separator, a quote or a newline in it
+string Report::CsvField(const string &text) {
+    if (text.find_first_of(",\"\r\n") == string::npos) return text;
+    string out = "\"";
+    for (char c : text) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
@@ -0,0 +1,66 @@
+//
+// Machine-readable output of a run, JSON lines or CSV
+//
+
+#ifndef ESPERF_REPORT_H
+#define ESPERF_REPORT_H
+
+#include <fstream>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+using namespace std;
+
+// Flat record of named values, such as the counters of an interval
+class Record {
+public:
+    explicit Record(const string &type);
+
+    void Add(const string &name, const string &value);
+
+    void Add(const string &name, const double value);
+
+    void Add(const string &name, const u_long value);
+
+    // Read back a numeric value, false if the record has none of the name
+    bool Number(const string &name, double *value) const;
+
+    const string &Type() const;
+
+private:
+    friend class Report;
+
+    struct Field {
+        string name;
+        string text;
+        // Strings are quoted in JSON, numbers are not
+        bool quoted;
+    };
+
+    string type_;
+    vector<Field> fields_;
+};
+
+class Report {
+public:
+    enum Format { JSON_LINES, CSV };
+
+    // jsonl or csv
+    static bool ParseFormat(const string &name, Format *format);
+
+    bool Open(const string &filename, const Format format, string *error);
+
+    bool IsOpen() const;
+
+    // Append the record and flush it, so that the file can be followed while running
+    void Write(const Record &record);
+
+private:
+    ofstream out_;
+    Format format_ = JSON_LINES;
+
+    static string CsvField(const string &text);
+};
+
+#endif //ESPERF_REPORT_H
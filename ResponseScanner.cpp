@@ -0,0 +1,265 @@
+//
+// Incremental scanner of Elasticsearch response metadata
+//
+
+#include <cstdlib>
+#include <cstring>
+
+#include "ResponseScanner.h"
+
+static const char REJECTED_EXECUTION[] = "es_rejected_execution_exception";
+// Longer types are cut, they do not need to match
+static const size_t TYPE_SIZE = 64;
+
+void ResponseScanner::Reset(bool capture) {
+    depth_ = 0;
+    object_mask_ = 0;
+    in_string_ = false;
+    escape_ = false;
+    expect_key_ = false;
+    in_key_ = false;
+    key_len_ = 0;
+    top_key_len_ = 0;
+    target_ = NONE;
+    value_len_ = 0;
+    took_ = -1;
+    timed_out_ = false;
+    shards_failed_ = 0;
+    errors_ = false;
+    capture_ = capture;
+    capture_string_ = nullptr;
+    capture_depth_ = -1;
+    hits_depth_ = 0;
+    container_ = NONE;
+    if (capture) {
+        scroll_id_.clear();
+        pit_id_.clear();
+        sort_.clear();
+    }
+    hits_ = -1;
+    error_depth_ = 0;
+    in_type_ = false;
+    error_type_.clear();
+    rejections_ = 0;
+}
+
+void ResponseScanner::Scan(const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = data[i];
+        // The sort array is copied as it is, strings and all
+        if (capture_depth_ >= 0) sort_.push_back(c);
+
+        if (in_string_) {
+            if (escape_) {
+                escape_ = false;
+            } else if (c == '\\') {
+                escape_ = true;
+                if (capture_string_) capture_string_->push_back(c);
+                continue;
+            } else if (c == '"') {
+                in_string_ = false;
+                in_key_ = false;
+                capture_string_ = nullptr;
+                if (in_type_) FinishType();
+                continue;
+            }
+            if (capture_string_ && (!in_type_ || type_.size() < TYPE_SIZE)) capture_string_->push_back(c);
+            // Keys longer than the buffer never match, so keep them over the size
+            if (in_key_) {
+                if (key_len_ < TOKEN_SIZE) key_[key_len_] = c;
+                key_len_++;
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '"':
+                in_string_ = true;
+                if (expect_key_ && IsObject()) {
+                    in_key_ = true;
+                    key_len_ = 0;
+                } else {
+                    if (target_ == SCROLL_ID || target_ == PIT_ID) {
+                        capture_string_ = target_ == SCROLL_ID ? &scroll_id_ : &pit_id_;
+                        capture_string_->clear();
+                    } else if (target_ == ERROR_TYPE) {
+                        capture_string_ = &type_;
+                        type_.clear();
+                        in_type_ = true;
+                    }
+                    target_ = NONE;
+                    container_ = NONE;
+                }
+                break;
+            case '{':
+            case '[':
+                if (c == '[' && container_ == SORT) {
+                    sort_.assign(1, c);
+                    capture_depth_ = depth_;
+                } else if (c == '[' && container_ == HITS) {
+                    hits_depth_ = depth_ + 1;
+                    hits_ = 0;
+                } else if (c == '{' && hits_depth_ > 0 && depth_ == hits_depth_) {
+                    hits_++;
+                }
+                // The object of an error key, whether the error of the response or of a bulk item
+                if (c == '{' && IsObject() && !expect_key_ && KeyIs(key_, key_len_, "error")) {
+                    error_depth_ = depth_ + 1;
+                }
+                container_ = NONE;
+                target_ = NONE;
+                if (depth_ < MAX_DEPTH) {
+                    if (c == '{') {
+                        object_mask_ |= (1ULL << depth_);
+                    } else {
+                        object_mask_ &= ~(1ULL << depth_);
+                    }
+                }
+                depth_++;
+                expect_key_ = c == '{';
+                break;
+            case '}':
+            case ']':
+                FinishValue();
+                depth_--;
+                expect_key_ = false;
+                if (capture_depth_ >= 0 && depth_ == capture_depth_) capture_depth_ = -1;
+                if (hits_depth_ > 0 && depth_ < hits_depth_) hits_depth_ = 0;
+                if (error_depth_ > 0 && depth_ < error_depth_) error_depth_ = 0;
+                break;
+            case ':':
+                expect_key_ = false;
+                ResolveTarget();
+                break;
+            case ',':
+                FinishValue();
+                container_ = NONE;
+                expect_key_ = IsObject();
+                break;
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                FinishValue();
+                break;
+            default:
+                if (target_ != NONE && value_len_ < TOKEN_SIZE - 1) value_[value_len_++] = c;
+        }
+    }
+}
+
+long ResponseScanner::Took() const {
+    return took_;
+}
+
+bool ResponseScanner::TimedOut() const {
+    return timed_out_;
+}
+
+long ResponseScanner::ShardsFailed() const {
+    return shards_failed_;
+}
+
+bool ResponseScanner::Errors() const {
+    return errors_;
+}
+
+bool ResponseScanner::IsPartialFailure() const {
+    return timed_out_ || shards_failed_ > 0 || errors_;
+}
+
+const std::string &ResponseScanner::ScrollId() const {
+    return scroll_id_;
+}
+
+const std::string &ResponseScanner::PitId() const {
+    return pit_id_;
+}
+
+const std::string &ResponseScanner::Sort() const {
+    return sort_;
+}
+
+long ResponseScanner::Hits() const {
+    return hits_;
+}
+
+const std::string &ResponseScanner::ErrorType() const {
+    return error_type_;
+}
+
+long ResponseScanner::Rejections() const {
+    return rejections_;
+}
+
+// The container at the current depth is an object
+bool ResponseScanner::IsObject() const {
+    return depth_ > 0 && depth_ <= MAX_DEPTH && (object_mask_ & (1ULL << (depth_ - 1)));
+}
+
+bool ResponseScanner::KeyIs(const char *key, int key_len, const char *name) const {
+    return key_len == static_cast<int>(strlen(name)) && memcmp(key, name, key_len) == 0;
+}
+
+// Decide whether the value following the key is one to keep
+void ResponseScanner::ResolveTarget() {
+    target_ = NONE;
+    container_ = NONE;
+    value_len_ = 0;
+    if (depth_ == 1) {
+        top_key_len_ = key_len_ < TOKEN_SIZE ? key_len_ : TOKEN_SIZE;
+        memcpy(top_key_, key_, top_key_len_);
+        if (key_len_ > TOKEN_SIZE) top_key_len_ = 0;
+
+        if (KeyIs(key_, key_len_, "took")) {
+            target_ = TOOK;
+        } else if (KeyIs(key_, key_len_, "timed_out")) {
+            target_ = TIMED_OUT;
+        } else if (KeyIs(key_, key_len_, "errors")) {
+            target_ = ERRORS;
+        } else if (capture_ && KeyIs(key_, key_len_, "_scroll_id")) {
+            target_ = SCROLL_ID;
+        } else if (capture_ && (KeyIs(key_, key_len_, "pit_id") || KeyIs(key_, key_len_, "id"))) {
+            // Opening a point in time answers with its id alone
+            target_ = PIT_ID;
+        }
+    } else if (depth_ == 2 && KeyIs(top_key_, top_key_len_, "_shards") && KeyIs(key_, key_len_, "failed")) {
+        target_ = SHARDS_FAILED;
+    } else if (capture_ && depth_ == 2 && KeyIs(top_key_, top_key_len_, "hits") && KeyIs(key_, key_len_, "hits")) {
+        container_ = HITS;
+    } else if (capture_ && hits_depth_ > 0 && depth_ == hits_depth_ + 1 && KeyIs(key_, key_len_, "sort")) {
+        container_ = SORT;
+    } else if (error_depth_ > 0 && depth_ == error_depth_ && KeyIs(key_, key_len_, "type")) {
+        target_ = ERROR_TYPE;
+    }
+}
+
+void ResponseScanner::FinishType() {
+    in_type_ = false;
+    if (type_ == REJECTED_EXECUTION) rejections_++;
+    if (error_type_.empty()) error_type_ = type_;
+}
+
+void ResponseScanner::FinishValue() {
+    if (target_ == NONE || value_len_ == 0) return;
+    value_[value_len_] = '\0';
+
+    switch (target_) {
+        case TOOK:
+            took_ = atol(value_);
+            break;
+        case TIMED_OUT:
+            timed_out_ = strcmp(value_, "true") == 0;
+            break;
+        case ERRORS:
+            errors_ = strcmp(value_, "true") == 0;
+            break;
+        case SHARDS_FAILED:
+            shards_failed_ = atol(value_);
+            break;
+        default:
+            break;
+    }
+    target_ = NONE;
+    value_len_ = 0;
+}
@@ -0,0 +1,112 @@
+//
+// Incremental scanner of Elasticsearch response metadata
+//
+
+#ifndef ESPERF_RESPONSESCANNER_H
+#define ESPERF_RESPONSESCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Picks took, timed_out, _shards.failed and errors out of a JSON response as it streams in,
+// without buffering the body or building a DOM
+class ResponseScanner {
+public:
+    // Capture also the values a session follows on with, which costs a copy of them
+    void Reset(bool capture = false);
+
+    // Feed the next chunk of the body, values may be split across chunks
+    void Scan(const char *data, size_t length);
+
+    // Server side time in msec, -1 if the response has none
+    long Took() const;
+
+    bool TimedOut() const;
+
+    long ShardsFailed() const;
+
+    bool Errors() const;
+
+    // Successful HTTP response which reports a failure in its body
+    bool IsPartialFailure() const;
+
+    // _scroll_id, and pit_id or the id of an opened point in time, as raw JSON string contents
+    const std::string &ScrollId() const;
+
+    const std::string &PitId() const;
+
+    // Raw JSON array of the sort values of the last hit, for search_after
+    const std::string &Sort() const;
+
+    // Number of hits.hits, -1 if the response has none
+    long Hits() const;
+
+    // type of the first error object, such as that of an HTTP error or of a failed bulk item, empty if none
+    const std::string &ErrorType() const;
+
+    // Error objects of the type es_rejected_execution_exception, a thread pool of the cluster with its queue full
+    long Rejections() const;
+
+private:
+    enum Target { NONE, TOOK, TIMED_OUT, ERRORS, SHARDS_FAILED, SCROLL_ID, PIT_ID, SORT, HITS, ERROR_TYPE };
+
+    static const int MAX_DEPTH = 64;
+    static const int TOKEN_SIZE = 16;
+
+    int depth_ = 0;
+    // Bit per depth, set if the container is an object
+    uint64_t object_mask_ = 0;
+    bool in_string_ = false;
+    bool escape_ = false;
+    bool expect_key_ = false;
+    bool in_key_ = false;
+
+    // The last key read, and the one of the top level object containing the current position
+    char key_[TOKEN_SIZE];
+    int key_len_ = 0;
+    char top_key_[TOKEN_SIZE];
+    int top_key_len_ = 0;
+
+    // Scalar value of an interesting key being read
+    Target target_ = NONE;
+    char value_[TOKEN_SIZE];
+    int value_len_ = 0;
+
+    long took_ = -1;
+    bool timed_out_ = false;
+    long shards_failed_ = 0;
+    bool errors_ = false;
+
+    bool capture_ = false;
+    // String value being copied, and the depth at which a raw array is being copied
+    std::string *capture_string_ = nullptr;
+    int capture_depth_ = -1;
+    // Depth inside the hits.hits array, 0 outside of it
+    int hits_depth_ = 0;
+    // Container to be opened next for a target, the hits.hits or a sort array
+    Target container_ = NONE;
+    std::string scroll_id_;
+    std::string pit_id_;
+    std::string sort_;
+    long hits_ = -1;
+    // Depth of the keys of the error object being read, 0 outside of one
+    int error_depth_ = 0;
+    // The type being copied, and the first one kept
+    std::string type_;
+    bool in_type_ = false;
+    std::string error_type_;
+    long rejections_ = 0;
+
+    bool IsObject() const;
+
+    bool KeyIs(const char *key, int key_len, const char *name) const;
+
+    void ResolveTarget();
+
+    void FinishValue();
+
+    void FinishType();
+};
+
+#endif //ESPERF_RESPONSESCANNER_H
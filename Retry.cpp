@@ -0,0 +1,93 @@
+//
+// Retries of the requests the cluster pushes back on, the way its production clients send them again
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include "Retry.h"
+
+// Retries the budget holds at most, which a burst of failures may spend at once
+static const double BUDGET_RESERVE = 10.0;
+
+bool RetryPolicy::Parse(const string &spec, string *error) {
+    stringstream items(spec);
+    for (string item; getline(items, item, ',');) {
+        if (item.empty()) continue;
+        size_t equal = item.find('=');
+        if (equal == string::npos || equal == 0) {
+            *error = "retry policy must be name=value: " + item;
+            return false;
+        }
+        string name = item.substr(0, equal);
+        double value = atof(item.substr(equal + 1).c_str());
+        if (value < 0) {
+            *error = "retry policy must not be negative: " + item;
+            return false;
+        }
+        if (name == "retries") {
+            max_retries_ = static_cast<u_int>(value);
+        } else if (name == "backoff") {
+            backoff_sec_ = value;
+        } else if (name == "max_backoff") {
+            max_backoff_sec_ = value;
+        } else if (name == "budget") {
+            budget_percent_ = value;
+        } else {
+            *error = "unknown retry policy: " + name;
+            return false;
+        }
+    }
+    if (max_backoff_sec_ < backoff_sec_) {
+        *error = "max_backoff must not be less than backoff";
+        return false;
+    }
+    return true;
+}
+
+bool RetryPolicy::IsEnabled() const {
+    return max_retries_ > 0;
+}
+
+u_int RetryPolicy::MaxRetries() const {
+    return max_retries_;
+}
+
+double RetryPolicy::BudgetPercent() const {
+    return budget_percent_;
+}
+
+bool RetryPolicy::IsRetryable(const long status, const CURLcode code) {
+    switch (code) {
+        case CURLE_OK:
+            return status == 429 || status == 502 || status == 503 || status == 504;
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Full jitter spreads the retries of the requests failed together, so that they do not come back at once
+double RetryPolicy::Backoff(const u_int retry, Random *random) const {
+    double ceiling = min(backoff_sec_ * ldexp(1.0, static_cast<int>(min(retry, 30u))), max_backoff_sec_);
+    return ceiling * random->NextDouble();
+}
+
+RetryBudget::RetryBudget(const double percent) : ratio_(percent / 100.0), tokens_(BUDGET_RESERVE) {}
+
+void RetryBudget::Deposit() {
+    tokens_ = min(tokens_ + ratio_, BUDGET_RESERVE);
+}
+
+bool RetryBudget::Withdraw() {
+    if (tokens_ < 1.0) return false;
+    tokens_ -= 1.0;
+    return true;
+}
@@ -0,0 +1,57 @@
+//
+// Retries of the requests the cluster pushes back on, the way its production clients send them again
+//
+
+#ifndef ESPERF_RETRY_H
+#define ESPERF_RETRY_H
+
+#include <curl/curl.h>
+#include <string>
+#include <sys/types.h>
+
+#include "Random.h"
+
+using namespace std;
+
+class RetryPolicy {
+public:
+    // Comma separated name=value of retries, backoff, max_backoff and budget, such as retries=3,backoff=0.1
+    bool Parse(const string &spec, string *error);
+
+    // A request is retried at all
+    bool IsEnabled() const;
+
+    u_int MaxRetries() const;
+
+    double BudgetPercent() const;
+
+    // Rejections, unavailable nodes and lost connections, which a production client sends again
+    static bool IsRetryable(const long status, const CURLcode code);
+
+    // Seconds to wait before the retry, drawn at random up to the backoff doubled for every retry so far
+    double Backoff(const u_int retry, Random *random) const;
+
+private:
+    u_int max_retries_ = 0;
+    double backoff_sec_ = 0.1;
+    double max_backoff_sec_ = 5.0;
+    double budget_percent_ = 10.0;
+};
+
+// Tokens a request earns in percent of a retry and a retry spends, so that the retries cannot multiply the load of an
+// overloaded cluster
+class RetryBudget {
+public:
+    explicit RetryBudget(const double percent = 0);
+
+    void Deposit();
+
+    // Take a retry out of the budget, false if none is left
+    bool Withdraw();
+
+private:
+    double ratio_;
+    double tokens_;
+};
+
+#endif //ESPERF_RETRY_H
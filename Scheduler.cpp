@@ -0,0 +1,38 @@
+//
+// Intended send times of an open-loop worker
+//
+
+#include "Scheduler.h"
+
+Scheduler::Scheduler(double rate_per_sec, double phase) : interval_(1.0 / rate_per_sec), phase_(phase) {}
+
+void Scheduler::Start(chrono::steady_clock::time_point start) {
+    start_ = start + chrono::duration_cast<chrono::steady_clock::duration>(interval_ * phase_);
+    sent_ = 0;
+    next_ = start_;
+}
+
+chrono::steady_clock::time_point Scheduler::Next() const {
+    return next_;
+}
+
+// Send times are computed from the start, so that rounding errors do not accumulate
+void Scheduler::Advance() {
+    sent_++;
+    next_ = start_ + chrono::duration_cast<chrono::steady_clock::duration>(interval_ * static_cast<double>(sent_));
+}
+
+void Scheduler::SetRate(double rate_per_sec, chrono::steady_clock::time_point now) {
+    interval_ = chrono::duration<double>(1.0 / rate_per_sec);
+    start_ = min(next_, now + chrono::duration_cast<chrono::steady_clock::duration>(interval_));
+    sent_ = 0;
+    next_ = start_;
+}
+
+double Scheduler::Lag(chrono::steady_clock::time_point now) const {
+    return chrono::duration<double>(now - next_).count();
+}
+
+double Scheduler::Interval() const {
+    return interval_.count();
+}
@@ -0,0 +1,45 @@
+//
+// Intended send times of an open-loop worker
+//
+
+#ifndef ESPERF_SCHEDULER_H
+#define ESPERF_SCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <sys/types.h>
+
+using namespace std;
+
+class Scheduler {
+public:
+    // Send rate_per_sec requests per second, shifted by phase of the interval
+    Scheduler(double rate_per_sec = 1.0, double phase = 0.0);
+
+    // Begin the schedule at start
+    void Start(chrono::steady_clock::time_point start);
+
+    // Intended send time of the next request
+    chrono::steady_clock::time_point Next() const;
+
+    // Move to the following send time
+    void Advance();
+
+    // Change the rate from the next send time, which comes earlier if the new period is shorter
+    void SetRate(double rate_per_sec, chrono::steady_clock::time_point now);
+
+    // Seconds from the intended send time until now
+    double Lag(chrono::steady_clock::time_point now) const;
+
+    // Period between two requests, sending later than this means being behind the schedule
+    double Interval() const;
+
+private:
+    chrono::duration<double> interval_;
+    double phase_;
+    chrono::steady_clock::time_point start_;
+    u_long sent_ = 0;
+    chrono::steady_clock::time_point next_;
+};
+
+#endif //ESPERF_SCHEDULER_H
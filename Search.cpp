@@ -0,0 +1,150 @@
+//
+// Search for the highest load level meeting a latency and error objective
+//
+
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include "Search.h"
+
+// Part of every probe left for the level to settle, only the rest is measured
+static const double SETTLE_FRACTION = 0.25;
+// Bisection of the rate stops once the levels passed and failed are this close
+static const double RATE_RESOLUTION = 0.05;
+// A rate is sustained only if this much of it is served successfully
+static const double RATE_KEPT = 0.95;
+static const u_int MAX_PROBES = 20;
+
+bool Search::ParseObjective(const string &spec, vector<pair<string, double>> *limits, string *error) {
+    limits->clear();
+    stringstream items(spec);
+    for (string item; getline(items, item, ',');) {
+        if (item.empty()) continue;
+        size_t equal = item.find('=');
+        if (equal == string::npos || equal == 0) {
+            *error = "objective must be name=value: " + item;
+            return false;
+        }
+        double value = atof(item.substr(equal + 1).c_str());
+        if (value < 0) {
+            *error = "objective must not be negative: " + item;
+            return false;
+        }
+        limits->push_back(make_pair(item.substr(0, equal), value));
+    }
+    if (limits->empty()) {
+        *error = "objective is empty";
+        return false;
+    }
+    return true;
+}
+
+Search::Search(Options *options, Stats *stats, Profile *profile) : options_(options), stats_(stats),
+                                                                    profile_(profile) {
+    string error;
+    if (options_->objective_.empty() || !ParseObjective(options_->objective_, &limits_, &error)) return;
+    enabled_ = true;
+    // A rate given is the first level of the search, otherwise the threads go from 1 up to those started
+    by_rate_ = options_->request_rate_ > 0;
+    StartProbe(by_rate_ ? options_->request_rate_ : 1.0, chrono::steady_clock::now());
+}
+
+bool Search::IsEnabled() const {
+    return enabled_;
+}
+
+chrono::steady_clock::time_point Search::NextChange() const {
+    if (!enabled_ || done_) return chrono::steady_clock::time_point::max();
+    return steady_ ? probe_end_ : steady_start_;
+}
+
+bool Search::Update(chrono::steady_clock::time_point now) {
+    if (!enabled_) return true;
+    if (done_) return false;
+    if (!steady_) {
+        if (now < steady_start_) return true;
+        // The snapshot adds up the counters, so the mark of the previous probe goes first
+        steady_mark_ = Metrics();
+        stats_->Snapshot(&steady_mark_);
+        steady_start_ = now;
+        steady_ = true;
+    }
+    if (now < probe_end_) return true;
+
+    Metrics metrics;
+    stats_->Snapshot(&metrics);
+    metrics.Subtract(steady_mark_);
+    if (Evaluate(metrics, chrono::duration<double>(now - steady_start_).count())) {
+        passed_ = level_;
+    } else {
+        failed_ = level_;
+    }
+
+    double level;
+    if (!NextLevel(&level)) {
+        done_ = true;
+        return false;
+    }
+    StartProbe(level, now);
+    return true;
+}
+
+void Search::StartProbe(const double level, chrono::steady_clock::time_point now) {
+    level_ = level;
+    probes_++;
+    if (by_rate_) {
+        profile_->Set(options_->num_threads_, level_);
+    } else {
+        profile_->Set(static_cast<u_int>(level_), options_->request_rate_);
+    }
+    chrono::steady_clock::duration probe = chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(options_->probe_sec_));
+    steady_start_ = now + chrono::duration_cast<chrono::steady_clock::duration>(probe * SETTLE_FRACTION);
+    probe_end_ = now + probe;
+    steady_ = false;
+}
+
+bool Search::Evaluate(const Metrics &metrics, const double elapsed_sec) {
+    Probe probe;
+    probe.threads = by_rate_ ? options_->num_threads_ : static_cast<u_int>(level_);
+    probe.rate = by_rate_ ? level_ : 0.0;
+    probe.elapsed_sec = elapsed_sec;
+    probe.metrics = metrics;
+
+    Record record("probe");
+    stats_->FillRecord(&record, metrics, elapsed_sec);
+    bool passed = metrics.success > 0;
+    for (auto &limit : limits_) {
+        double value = 0.0;
+        // A field the summary does not have cannot be met
+        if (!record.Number(limit.first, &value) || value > limit.second) passed = false;
+    }
+    double per_sec = 0.0;
+    if (by_rate_ && (!record.Number("requests_per_sec", &per_sec) || per_sec < level_ * RATE_KEPT)) passed = false;
+    probe.passed = passed;
+    stats_->AddProbe(probe);
+    return passed;
+}
+
+bool Search::NextLevel(double *level) const {
+    if (probes_ >= MAX_PROBES) return false;
+    if (failed_ == 0.0) {
+        if (by_rate_) {
+            *level = level_ * 2;
+            return true;
+        }
+        // Every thread started meets the objective
+        if (level_ >= options_->num_threads_) return false;
+        *level = min(level_ * 2, static_cast<double>(options_->num_threads_));
+        return true;
+    }
+    if (by_rate_) {
+        if (failed_ - passed_ <= failed_ * RATE_RESOLUTION) return false;
+        *level = (passed_ + failed_) / 2;
+        return true;
+    }
+    if (failed_ - passed_ <= 1) return false;
+    *level = floor((passed_ + failed_) / 2);
+    return true;
+}
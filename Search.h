@@ -0,0 +1,65 @@
+//
+// Search for the highest load level meeting a latency and error objective
+//
+
+#ifndef ESPERF_SEARCH_H
+#define ESPERF_SEARCH_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Options.h"
+#include "Profile.h"
+#include "Stats.h"
+
+using namespace std;
+
+class Search {
+public:
+    // Comma separated name=value of the summary fields, such as latency_p99=0.2,error_percent=0.1, none of which
+    // a probe may exceed
+    static bool ParseObjective(const string &spec, vector<pair<string, double>> *limits, string *error);
+
+    // Hold the level of the first probe unless no objective is given
+    Search(Options *options, Stats *stats, Profile *profile);
+
+    bool IsEnabled() const;
+
+    // Time at which the steady state of the probe starts or the probe ends
+    chrono::steady_clock::time_point NextChange() const;
+
+    // Move on to the next probe when the time has come, return false once the search is done
+    bool Update(chrono::steady_clock::time_point now);
+
+private:
+    Options *options_;
+    Stats *stats_;
+    Profile *profile_;
+    vector<pair<string, double>> limits_;
+    bool enabled_ = false;
+    bool done_ = false;
+
+    // Threads in the closed-loop mode, requests/sec over all threads when a rate is given
+    bool by_rate_ = false;
+    double level_ = 0.0;
+    // Highest level passed and lowest one failed so far, 0 if none
+    double passed_ = 0.0;
+    double failed_ = 0.0;
+    u_int probes_ = 0;
+
+    chrono::steady_clock::time_point steady_start_;
+    chrono::steady_clock::time_point probe_end_;
+    bool steady_ = false;
+    Metrics steady_mark_;
+
+    void StartProbe(const double level, chrono::steady_clock::time_point now);
+
+    // Check the steady state of the probe against the objective
+    bool Evaluate(const Metrics &metrics, const double elapsed_sec);
+
+    // Double the level until a probe fails, then bisect between the levels passed and failed, false when done
+    bool NextLevel(double *level) const;
+};
+
+#endif //ESPERF_SEARCH_H
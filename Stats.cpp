@@ -4,13 +4,65 @@
 //
 
 #include "Stats.h"
+#include "Coordinator.h"
 
 // Display adjustment
 static const int PROGRESS_WIDTH = 9;
 static const int RESULT_WIDTH = 15;
 
-static const string PROGRESS_HEADER = "------------------------ --------- --------- -------- -------- -------- --------";
+static const string PROGRESS_HEADER = "------------------------ --------- --------- -------- -------- -------- -------- --------";
+static const string PROGRESS_HEADER_DECODED = " -------- --------";
+static const string PROGRESS_HEADER_CORRECTED = " --------";
+static const string PROGRESS_HEADER_TOOK = " --------";
+static const string PROGRESS_HEADER_PHASES = " -------- -------- --------";
+static const string PROGRESS_HEADER_PERCENTILES = " -------- -------- -------- -------- --------";
+static const string PROGRESS_HEADER_DOCS = " ---------";
+static const string PROGRESS_HEADER_USAGE = " -------- -------- --------";
+static const string PROGRESS_HEADER_RETRIES = " --------";
 static const string RESULT_HEADER = "----------------------------------- Results ------------------------------------";
+static const string QUERIES_HEADER = "----------------------------------- Queries ------------------------------------";
+static const string STAGES_HEADER = "----------------------------------- Stages -------------------------------------";
+static const string NODES_HEADER = "------------------------------------ Nodes -------------------------------------";
+static const string SEARCH_HEADER = "----------------------------------- Search -------------------------------------";
+static const string PAGES_HEADER = "------------------------------------ Pages -------------------------------------";
+static const string RESPONSES_HEADER = "---------------------------------- Responses -----------------------------------";
+static const int LABEL_WIDTH = 24;
+
+// The client is saturated from this percent of its CPUs, or of a CPU for a worker thread
+static const double SATURATED_PERCENT = 90.0;
+
+// A replayed request sent later than this is behind the timeline of the log
+static const double REPLAY_TOLERANCE_SEC = 0.001;
+
+// Percentiles to show in progress and results
+static const double PERCENTILES[] = {50.0, 90.0, 99.0, 99.9};
+static const char *PERCENTILE_LABELS[] = {"p50", "p90", "p99", "p99.9"};
+static const char *PERCENTILE_FIELDS[] = {"latency_p50", "latency_p90", "latency_p99", "latency_p99_9"};
+
+// Phases of the transfers in the results and the output
+static const char *PHASE_LABELS[] = {"Lookup", "Connect", "TLS", "Pretransfer", "TTFB", "Download"};
+static const char *PHASE_FIELDS[] = {"lookup", "connect", "tls", "pretransfer", "ttfb", "download"};
+
+static double UsecToSec(const uint64_t usec) {
+    return usec / 1000000.0;
+}
+
+static uint64_t SecToUsec(const double sec) {
+    return static_cast<uint64_t>(sec * 1000000);
+}
+
+static u_long TimevalToUsec(const struct timeval &time) {
+    return static_cast<u_long>(time.tv_sec) * 1000000 + static_cast<u_long>(time.tv_usec);
+}
+
+// Percent of the CPUs available, and of a single CPU for the busiest worker thread
+static double CpuPercent(const Metrics &metrics) {
+    return metrics.cpu_available > 0 ? metrics.cpu * 100.0 / metrics.cpu_available : 0.0;
+}
+
+static double ThreadCpuPercent(const Metrics &metrics) {
+    return min(metrics.threads.Max() / 10000.0, 100.0);
+}
 
 // Print progress, called by Timer every interval second
 void Stats::ShowProgress() {
@@ -18,94 +70,546 @@ void Stats::ShowProgress() {
     time_t now_t = time(NULL);
     strftime(time_buff, sizeof(time_buff), "%FT%T%z", localtime(&now_t));
 
+    // Merge the slots of the workers and take the difference from the previous progress
+    Metrics now;
+    Collect(&now);
+    Metrics interval = now;
+    interval.Subtract(prev_);
+    prev_ = now;
+    chrono::steady_clock::time_point clock_now = chrono::steady_clock::now();
+    double interval_sec = chrono::duration<double>(clock_now - clock_prev_).count();
+    clock_prev_ = clock_now;
+
     u_long upload = 0;
     u_long download = 0;
-
-    if ((success_ - prev_success_) != 0) {
-        upload = static_cast<u_int>((size_upload_ - prev_size_upload_) / (success_ - prev_success_));
-        download = static_cast<u_int>((size_download_ - prev_size_download_) / (success_ - prev_success_));
-    }
-
+    u_long upload_decoded = 0;
+    u_long download_decoded = 0;
     double response = 0.0;
+    double corrected = 0.0;
+    double took = 0.0;
 
-    if (success_ > 0) {
-        response = (time_transfer_ - prev_time_transfer_) / (success_ - prev_success_) ;
+    if (interval.success != 0) {
+        upload = static_cast<u_int>(interval.size_upload / interval.success);
+        download = static_cast<u_int>(interval.size_download / interval.success);
+        upload_decoded = interval.size_upload_decoded / interval.success;
+        download_decoded = interval.size_download_decoded / interval.success;
+        response = UsecToSec(interval.time_transfer) / interval.success;
+        corrected = UsecToSec(interval.time_response) / interval.success;
+    }
+    if (interval.took.Count() != 0) {
+        took = UsecToSec(interval.time_took) / interval.took.Count();
     }
 
     stringstream msg;
-    msg << time_buff << " " << setw(PROGRESS_WIDTH) << success_ - prev_success_ << " "
-         << setw(PROGRESS_WIDTH) << error_curl_ - prev_error_curl_
-         << setw(PROGRESS_WIDTH) << error_http_ - prev_error_http_
+    msg << time_buff << " " << setw(PROGRESS_WIDTH) << interval.success << " "
+         << setw(PROGRESS_WIDTH) << interval.error_curl
+         << setw(PROGRESS_WIDTH) << interval.error_http
+         << setw(PROGRESS_WIDTH) << interval.error_partial
          << setw(PROGRESS_WIDTH) << upload
-         << setw(PROGRESS_WIDTH) << download
-         << setw(PROGRESS_WIDTH) << fixed << setprecision(4) << response << endl;
+         << setw(PROGRESS_WIDTH) << download;
+    if (IsCompressed()) msg << setw(PROGRESS_WIDTH) << upload_decoded << setw(PROGRESS_WIDTH) << download_decoded;
+    msg << setw(PROGRESS_WIDTH) << fixed << setprecision(4) << response;
+    if (options_->IsOpenLoop()) {
+        msg << setw(PROGRESS_WIDTH) << corrected;
+    }
+    msg << setw(PROGRESS_WIDTH) << took;
+
+    // Connections opened, and the average connection setup and time to first byte of the successful requests
+    double setup = 0.0;
+    double ttfb = 0.0;
+    if (interval.success != 0) {
+        setup = UsecToSec(interval.time_phases[PHASE_LOOKUP] + interval.time_phases[PHASE_CONNECT] +
+                          interval.time_phases[PHASE_TLS]) / interval.success;
+        ttfb = UsecToSec(interval.time_phases[PHASE_TTFB]) / interval.success;
+    }
+    msg << setw(PROGRESS_WIDTH) << interval.connects << setw(PROGRESS_WIDTH) << setup << setw(PROGRESS_WIDTH) << ttfb;
+
+    const Histogram &latency = options_->IsOpenLoop() ? interval.response : interval.transfer;
+    for (double percentile : PERCENTILES) {
+        msg << setw(PROGRESS_WIDTH) << UsecToSec(latency.ValueAtPercentile(percentile));
+    }
+    msg << setw(PROGRESS_WIDTH) << UsecToSec(latency.Max());
+    if (options_->bulk_docs_ > 0) {
+        msg << " " << setw(PROGRESS_WIDTH) << interval.docs;
+    }
+    msg << setprecision(1) << setw(PROGRESS_WIDTH) << CpuPercent(interval) << setw(PROGRESS_WIDTH)
+        << ThreadCpuPercent(interval) << setw(PROGRESS_WIDTH)
+        << interval.switches_voluntary + interval.switches_involuntary << setprecision(4);
+    if (options_->retry_.IsEnabled()) msg << setw(PROGRESS_WIDTH) << interval.retries;
+    msg << endl;
+
+    // The errors of the interval by their status and curl error, a rejection from an error of a bad query
+    string taxonomy = Taxonomy(interval);
+    if (!taxonomy.empty()) msg << "  " << taxonomy << endl;
+
+    // A line for each node under the columns of the total, with the average in Response
+    for (size_t i = 0; i < interval.nodes.size(); i++) {
+        const GroupMetrics &node = interval.nodes[i];
+        double average = node.success > 0 ? UsecToSec(node.time_latency) / node.success : 0.0;
+        msg << setw(24) << left << ("  " + options_->nodes_[i]).substr(0, 24) << right << " "
+            << setw(PROGRESS_WIDTH) << node.success << " " << setw(PROGRESS_WIDTH) << node.error_curl
+            << setw(PROGRESS_WIDTH) << node.error_http << setw(PROGRESS_WIDTH) << node.error_partial
+            << setw(PROGRESS_WIDTH) << "" << setw(PROGRESS_WIDTH) << "";
+        if (IsCompressed()) msg << setw(PROGRESS_WIDTH) << "" << setw(PROGRESS_WIDTH) << "";
+        msg << setw(PROGRESS_WIDTH) << average;
+        if (options_->IsOpenLoop()) msg << setw(PROGRESS_WIDTH) << "";
+        msg << setw(PROGRESS_WIDTH) << "" << setw(PROGRESS_WIDTH) << "" << setw(PROGRESS_WIDTH) << ""
+            << setw(PROGRESS_WIDTH) << "";
+        for (double percentile : PERCENTILES) {
+            msg << setw(PROGRESS_WIDTH) << UsecToSec(node.latency.ValueAtPercentile(percentile));
+        }
+        msg << setw(PROGRESS_WIDTH) << UsecToSec(node.latency.Max()) << endl;
+    }
     safe_cout(msg.str());
 
-    prev_success_ = success_;
-    prev_error_curl_ = error_curl_;
-    prev_error_http_ = error_http_;
-    prev_size_upload_ = size_upload_;
-    prev_size_download_ = size_download_;
-    prev_time_transfer_ = time_transfer_;
+    if (options_->report_.IsOpen()) {
+        Record record("interval");
+        record.Add("timestamp", string(time_buff));
+        FillRecord(&record, interval, interval_sec);
+        options_->report_.Write(record);
+        WriteGroups("interval_node", interval.nodes, options_->nodes_, interval_sec);
+    }
+
+    // Latency is not measured faithfully once the client itself cannot keep the rate
+    if (interval.lag.Count() > 0) {
+        stringstream msg_behind;
+        msg_behind << "Warning: " << interval.lag.Count() << " requests sent behind schedule, max lag " << fixed
+                   << setprecision(4) << UsecToSec(interval.lag.Max()) << " sec" << endl;
+        safe_cerr(msg_behind.str());
+    }
 
+    // Nor is it once the client itself runs out of CPU, which then limits the load rather than the cluster. The
+    // short last interval measures too little CPU to tell
+    bool saturated = CpuPercent(interval) >= SATURATED_PERCENT || ThreadCpuPercent(interval) >= SATURATED_PERCENT;
+    if (saturated && interval_sec >= options_->interval_sec_ / 2.0) {
+        saturated_intervals_++;
+        stringstream msg_saturated;
+        msg_saturated << "Warning: client saturated, CPU " << fixed << setprecision(1) << CpuPercent(interval)
+                      << "% of its CPUs and the busiest worker thread " << ThreadCpuPercent(interval)
+                      << "% of a CPU, the results are not valid" << endl;
+        safe_cerr(msg_saturated.str());
+    }
 }
 
 // Print the final result
 void Stats::ShowResult() {
     if (finished_) {
-        double elapsed_sec = ((clock_stop_ - clock_start_).count()) * chrono::steady_clock::period::num /
-                             static_cast<double>(chrono::steady_clock::period::den) - options_->warmup_sec_;
+        Metrics result;
+        Collect(&result);
+        double elapsed_sec = 0.0;
+        if (warmed_up_) {
+            result.Subtract(warm_up_);
+            elapsed_sec = chrono::duration<double>(clock_stop_ - clock_warm_up_).count();
+        } else {
+            // The run has ended within the warm-up
+            result = Metrics();
+        }
+        double per_sec = elapsed_sec > 0 ? 1.0 / elapsed_sec : 0.0;
 
         cout << RESULT_HEADER << endl;
 
 
         Stats::PrintLine("Time after warm-up (sec)", elapsed_sec);
-        Stats::PrintLine("Number of success", static_cast<u_int>(wu_success_));
-        Stats::PrintLine("Number of connection failure", static_cast<u_int>(wu_error_curl_));
-        Stats::PrintLine("Number of HTTP response >400", static_cast<u_int>(wu_error_http_));
-        Stats::PrintLine("Average successful requests/sec", static_cast<u_int> (wu_success_ / elapsed_sec));
-        Stats::PrintLine("Upload throughput (byte/sec)", static_cast<u_int>(wu_size_upload_ / elapsed_sec));
-        Stats::PrintLine("Download throughput (byte/sec)", static_cast<u_int> (wu_size_download_ / elapsed_sec));
+        Stats::PrintLine("Number of success", static_cast<u_int>(result.success));
+        Stats::PrintLine("Number of connection failure", static_cast<u_int>(result.error_curl));
+        Stats::PrintLine("Number of HTTP response >400", static_cast<u_int>(result.error_http));
+        Stats::PrintLine("Number of partial failure", static_cast<u_int>(result.error_partial));
+        Stats::PrintLine("Number of rejected executions", static_cast<u_int>(result.rejections));
+        if (options_->retry_.IsEnabled()) {
+            Stats::PrintLine("Number of retries", static_cast<u_int>(result.retries));
+            Stats::PrintLine("Retries denied by the budget", static_cast<u_int>(result.retries_denied));
+            Stats::PrintLine("Successful after a retry", static_cast<u_int>(result.retried.Count()));
+        }
+        Stats::PrintLine("Average successful requests/sec", static_cast<u_int> (result.success * per_sec));
+        Stats::PrintLine("Upload throughput (byte/sec)", static_cast<u_int>(result.size_upload * per_sec));
+        Stats::PrintLine("Download throughput (byte/sec)", static_cast<u_int> (result.size_download * per_sec));
+        if (IsCompressed()) {
+            // Bandwidth saved by the compression, against the wire bytes above
+            Stats::PrintLine("Upload decoded (byte/sec)", static_cast<u_int>(result.size_upload_decoded * per_sec));
+            Stats::PrintLine("Download decoded (byte/sec)", static_cast<u_int>(result.size_download_decoded * per_sec));
+        }
+        if (options_->bulk_docs_ > 0) {
+            Stats::PrintLine("Number of documents", static_cast<u_int>(result.docs));
+            Stats::PrintLine("Average documents/sec", static_cast<u_int>(result.docs * per_sec));
+            Stats::PrintLine("Upload throughput (MB/sec)", result.size_upload * per_sec / 1048576.0);
+            Stats::PrintLine("Download throughput (MB/sec)", result.size_download * per_sec / 1048576.0);
+        }
         double time_transfer = 0.0;
-        if (wu_success_ > 0) {
-            time_transfer = static_cast<double> (wu_time_transfer_ / wu_success_);
+        if (result.success > 0) {
+            time_transfer = UsecToSec(result.time_transfer) / result.success;
         }
         Stats::PrintLine("Average time transfer (sec)", time_transfer);
+        double time_took = 0.0;
+        if (result.took.Count() > 0) {
+            time_took = UsecToSec(result.time_took) / result.took.Count();
+        }
+        Stats::PrintLine("Average server took (sec)", time_took);
+        Stats::PrintLine("Number of new connections", static_cast<u_int>(result.connects));
+
+        // The gap between the client latency and took is spent in the network and the coordinating node
+        vector<pair<string, const Histogram *>> latencies;
+        latencies.push_back(make_pair("Transfer", &result.transfer));
+        if (options_->IsOpenLoop()) latencies.push_back(make_pair("Intended", &result.response));
+        latencies.push_back(make_pair("Took", &result.took));
+        // From the first intended send time, backoffs included
+        if (options_->retry_.IsEnabled()) latencies.push_back(make_pair("Retried", &result.retried));
+        PrintPercentiles("Latency (sec)", latencies);
+
+        // Where the transfer time goes, connection setup against the server
+        vector<pair<string, const Histogram *>> phases;
+        for (int i = 0; i < PHASE_COUNT; i++) phases.push_back(make_pair(PHASE_LABELS[i], &result.phases[i]));
+        PrintPercentiles("Phases (sec)", phases);
+
+        if (options_->IsOpenLoop()) {
+            double time_response = 0.0;
+            if (result.success > 0) {
+                time_response = UsecToSec(result.time_response) / result.success;
+            }
+            Stats::PrintLine("Average corrected response (sec)", time_response);
+            Stats::PrintLine("Requests behind schedule", static_cast<u_int>(result.lag.Count()));
+            Stats::PrintLine("Maximum schedule lag (sec)", UsecToSec(result.lag.Max()));
+        }
+        if (options_->replay_.IsOpen()) {
+            // The agents read the log of their own
+            if (!coordinator_) {
+                Stats::PrintLine("Replay lines skipped", static_cast<u_int>(options_->replay_.Skipped()));
+            }
+            vector<pair<string, const Histogram *>> lateness;
+            lateness.push_back(make_pair("Lateness", &result.lateness));
+            PrintPercentiles("Replay lateness (sec)", lateness);
+        }
+        // The entries of the whole run, warm-up included, those dropped found the ring of their worker full
+        if (!options_->log_filename_.empty() && !coordinator_) {
+            Stats::PrintLine("Requests logged", static_cast<u_int>(options_->logger_.Written()));
+            Stats::PrintLine("Log entries dropped", static_cast<u_int>(options_->logger_.Dropped()));
+        }
+
+        // Load the client itself put on the machine, the results are not valid if it was saturated
+        Stats::PrintLine("Client CPU (percent of its CPUs)", CpuPercent(result));
+        Stats::PrintLine("Busiest worker thread CPU (percent)", ThreadCpuPercent(result));
+        Stats::PrintLine("Voluntary context switches", static_cast<u_int>(result.switches_voluntary));
+        Stats::PrintLine("Involuntary context switches", static_cast<u_int>(result.switches_involuntary));
+        if (saturated_intervals_ > 0) {
+            Stats::PrintLine("Intervals with the client saturated", saturated_intervals_);
+            safe_cerr("Warning: the client was saturated, so the load was limited by esperf rather than the cluster\n");
+        }
+
+        if (!result.pages.empty()) {
+            Stats::PrintLine("Number of sessions", static_cast<u_int>(result.sessions));
+            Stats::PrintLine("Sessions cut short by a failure", static_cast<u_int>(result.sessions_failed));
+        }
+
+        if (!result.queries.empty()) {
+            vector<string> labels;
+            for (size_t i = 0; i < options_->workload_.Size(); i++) labels.push_back(options_->workload_.At(i).label);
+            PrintGroups(QUERIES_HEADER, "Query", result.queries, labels);
+        }
+        if (!result.nodes.empty()) PrintGroups(NODES_HEADER, "Node", result.nodes, options_->nodes_);
+        if (!result.pages.empty()) {
+            // Cost of a page by its depth, where the open and close steps show only if the sessions have them
+            vector<GroupMetrics> pages;
+            vector<string> labels;
+            vector<string> all_labels = PageLabels();
+            for (size_t i = 0; i < result.pages.size(); i++) {
+                const GroupMetrics &page = result.pages[i];
+                if (page.success + page.error_curl + page.error_http + page.error_partial == 0) continue;
+                pages.push_back(page);
+                labels.push_back(all_labels[i]);
+            }
+            PrintGroups(PAGES_HEADER, "Page", pages, labels);
+        }
+        PrintResponses(result);
+        if (!options_->stages_.empty()) PrintStages();
+        if (!probes_.empty()) PrintProbes();
+
+        char time_buff[80];
+        time_t now_t = time(NULL);
+        strftime(time_buff, sizeof(time_buff), "%FT%T%z", localtime(&now_t));
+        summary_.Add("timestamp", string(time_buff));
+        FillRecord(&summary_, result, elapsed_sec);
+        summary_.Add("saturated_intervals", static_cast<u_long>(saturated_intervals_));
+        if (!probes_.empty()) {
+            Probe none;
+            const Probe *capacity = Capacity() ? Capacity() : &none;
+            double per_sec = capacity->elapsed_sec > 0 ? capacity->metrics.success / capacity->elapsed_sec : 0.0;
+            summary_.Add("capacity_threads", static_cast<u_long>(capacity->threads));
+            summary_.Add("capacity_rate", capacity->rate);
+            summary_.Add("capacity_requests_per_sec", per_sec);
+        }
+        if (options_->report_.IsOpen()) {
+            options_->report_.Write(summary_);
+            vector<string> labels;
+            for (size_t i = 0; i < options_->workload_.Size(); i++) labels.push_back(options_->workload_.At(i).label);
+            WriteGroups("query", result.queries, labels, elapsed_sec);
+            WriteGroups("node", result.nodes, options_->nodes_, elapsed_sec);
+            WriteGroups("page", result.pages, PageLabels(), elapsed_sec);
+        }
     }
 }
 
-// Return if all the requests are finished
-bool Stats::IsFinished() const {
-    return finished_;
+bool Stats::CheckBaseline() {
+    if (!options_->baseline_.IsLoaded() || !finished_) return true;
+    string table;
+    bool passed = options_->baseline_.Check(summary_, &table);
+    safe_cout(table);
+    if (!passed) safe_cerr("Error: regression from the baseline " + options_->baseline_.Filename() + "\n");
+    return passed;
 }
 
-// Safely count the number of requests and other statistics
-void Stats::CountResult(const int success, const int error_curl, const int error_http,
-                        const u_long size_upload, const u_long size_download, const double time_transfer) {
+void Stats::FillRecord(Record *record, const Metrics &metrics, const double elapsed_sec) {
+    bool rate = options_->IsOpenLoop();
+    double per_sec = elapsed_sec > 0 ? 1.0 / elapsed_sec : 0.0;
+    const Histogram &latency = rate ? metrics.response : metrics.transfer;
+    u_long time_latency = rate ? metrics.time_response : metrics.time_transfer;
 
-    success_ += success;
-    error_curl_ += error_curl;
-    error_http_ += error_http;
-    size_upload_ += size_upload;
-    size_download_ += size_download;
-    add_to_atomic_double(&time_transfer_, time_transfer);
+    record->Add("elapsed_sec", elapsed_sec);
+    record->Add("success", metrics.success);
+    record->Add("error_curl", metrics.error_curl);
+    record->Add("error_http", metrics.error_http);
+    record->Add("error_partial", metrics.error_partial);
+    u_long failures = metrics.error_curl + metrics.error_http + metrics.error_partial;
+    u_long requests = metrics.success + failures;
+    record->Add("error_percent", requests > 0 ? failures * 100.0 / requests : 0.0);
+    record->Add("requests_per_sec", metrics.success * per_sec);
+    record->Add("upload_bytes_per_sec", metrics.size_upload * per_sec);
+    record->Add("download_bytes_per_sec", metrics.size_download * per_sec);
+    record->Add("upload_decoded_bytes_per_sec", metrics.size_upload_decoded * per_sec);
+    record->Add("download_decoded_bytes_per_sec", metrics.size_download_decoded * per_sec);
+    if (options_->bulk_docs_ > 0) record->Add("docs_per_sec", metrics.docs * per_sec);
+    record->Add("latency_avg", metrics.success > 0 ? UsecToSec(time_latency) / metrics.success : 0.0);
+    for (size_t i = 0; i < 4; i++) {
+        record->Add(PERCENTILE_FIELDS[i], UsecToSec(latency.ValueAtPercentile(PERCENTILES[i])));
+    }
+    record->Add("latency_max", UsecToSec(latency.Max()));
+    record->Add("took_avg", metrics.took.Count() > 0 ? UsecToSec(metrics.time_took) / metrics.took.Count() : 0.0);
+    if (rate) record->Add("behind_schedule", static_cast<u_long>(metrics.lag.Count()));
+    if (options_->replay_.IsOpen()) {
+        record->Add("lateness_p50", UsecToSec(metrics.lateness.ValueAtPercentile(50.0)));
+        record->Add("lateness_p99", UsecToSec(metrics.lateness.ValueAtPercentile(99.0)));
+        record->Add("lateness_max", UsecToSec(metrics.lateness.Max()));
+    }
+    record->Add("new_connections", metrics.connects);
+    record->Add("rejections", metrics.rejections);
+    if (options_->retry_.IsEnabled()) {
+        record->Add("retries", metrics.retries);
+        record->Add("retries_denied", metrics.retries_denied);
+        record->Add("retried", static_cast<u_long>(metrics.retried.Count()));
+        record->Add("retried_p50", UsecToSec(metrics.retried.ValueAtPercentile(50.0)));
+        record->Add("retried_p99", UsecToSec(metrics.retried.ValueAtPercentile(99.0)));
+    }
+    for (int i = 0; i < STATUS_CODES; i++) {
+        if (metrics.statuses[i] > 0) record->Add("http_" + to_string(i), metrics.statuses[i]);
+    }
+    for (int i = 0; i < CURL_CODES; i++) {
+        if (metrics.curl_errors[i] > 0) record->Add("curl_" + to_string(i), metrics.curl_errors[i]);
+    }
+    if (!metrics.pages.empty()) {
+        record->Add("sessions", metrics.sessions);
+        record->Add("sessions_failed", metrics.sessions_failed);
+    }
+    record->Add("client_cpu_percent", CpuPercent(metrics));
+    record->Add("worker_cpu_max_percent", ThreadCpuPercent(metrics));
+    record->Add("context_switches_voluntary", metrics.switches_voluntary);
+    record->Add("context_switches_involuntary", metrics.switches_involuntary);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        string field = PHASE_FIELDS[i];
+        record->Add(field + "_avg", metrics.success > 0 ? UsecToSec(metrics.time_phases[i]) / metrics.success : 0.0);
+        record->Add(field + "_p50", UsecToSec(metrics.phases[i].ValueAtPercentile(50.0)));
+        record->Add(field + "_p99", UsecToSec(metrics.phases[i].ValueAtPercentile(99.0)));
+    }
+}
 
-    if ((chrono::steady_clock::now() - clock_start_).count() * chrono::steady_clock::period::num
-        / static_cast<double>(chrono::steady_clock::period::den) > options_->warmup_sec_) {
-        wu_success_ += success;
-        wu_error_curl_ += error_curl;
-        wu_error_http_ += error_http;
-        wu_size_upload_ += size_upload;
-        wu_size_download_ += size_download;
-        add_to_atomic_double(&wu_time_transfer_, time_transfer);
+void Stats::FillGroupRecord(Record *record, const GroupMetrics &group, const double elapsed_sec) {
+    double per_sec = elapsed_sec > 0 ? 1.0 / elapsed_sec : 0.0;
+    record->Add("elapsed_sec", elapsed_sec);
+    record->Add("success", group.success);
+    record->Add("error_curl", group.error_curl);
+    record->Add("error_http", group.error_http);
+    record->Add("error_partial", group.error_partial);
+    record->Add("requests_per_sec", group.success * per_sec);
+    record->Add("latency_avg", group.success > 0 ? UsecToSec(group.time_latency) / group.success : 0.0);
+    for (size_t i = 0; i < 4; i++) {
+        record->Add(PERCENTILE_FIELDS[i], UsecToSec(group.latency.ValueAtPercentile(PERCENTILES[i])));
     }
+    record->Add("latency_max", UsecToSec(group.latency.Max()));
+}
 
-    if ((success_ + error_curl_ + error_http_) == options_->num_recurrence_ ) {
-        clock_stop_ = chrono::steady_clock::now();
-        finished_ = true;
+void Stats::WriteGroups(const string &type, const vector<GroupMetrics> &groups, const vector<string> &labels,
+                        const double elapsed_sec) {
+    for (size_t i = 0; i < groups.size(); i++) {
+        Record record(type);
+        record.Add("label", labels[i]);
+        FillGroupRecord(&record, groups[i], elapsed_sec);
+        options_->report_.Write(record);
     }
 }
 
+void Stats::Finish() {
+    lock_guard<mutex> lock(mtx_finished_);
+    clock_stop_ = chrono::steady_clock::now();
+    finished_ = true;
+    cv_finished_.notify_all();
+}
+
+bool Stats::WaitUntilFinished(const chrono::steady_clock::time_point deadline) {
+    unique_lock<mutex> lock(mtx_finished_);
+    return cv_finished_.wait_until(lock, deadline, [this] { return finished_; });
+}
+
+void Stats::MarkWarmUp() {
+    Collect(&warm_up_);
+    clock_warm_up_ = chrono::steady_clock::now();
+    warmed_up_ = true;
+}
+
+void Stats::MarkStage() {
+    stage_marks_.push_back(Metrics());
+    Collect(&stage_marks_.back());
+    stage_clocks_.push_back(chrono::steady_clock::now());
+}
+
+chrono::steady_clock::time_point Stats::ClockStart() const {
+    return clock_start_;
+}
+
+// Merge the slots of all the workers, or of all the agents
+void Stats::Collect(Metrics *metrics) const {
+    if (coordinator_) {
+        coordinator_->Collect(metrics);
+        return;
+    }
+    for (auto &slot : slots_) {
+        metrics->Add(*slot);
+    }
+    CollectUsage(metrics);
+}
+
+void Stats::CollectUsage(Metrics *metrics) const {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        metrics->cpu += TimevalToUsec(usage.ru_utime) + TimevalToUsec(usage.ru_stime) - cpu_start_;
+        metrics->switches_voluntary += static_cast<u_long>(usage.ru_nvcsw) - switches_voluntary_start_;
+        metrics->switches_involuntary += static_cast<u_long>(usage.ru_nivcsw) - switches_involuntary_start_;
+    }
+    chrono::microseconds elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() -
+                                                                               clock_start_);
+    metrics->cpu_available += static_cast<u_long>(elapsed.count()) * cpus_available_;
+    thread_cpu_.AddTo(&metrics->threads);
+}
+
+void Stats::AddWorkerThread(thread *worker) {
+#ifdef __linux__
+    clockid_t clock;
+    if (pthread_getcpuclockid(worker->native_handle(), &clock) == 0) thread_clocks_.push_back(make_pair(clock, 0));
+#endif
+}
+
+void Stats::SampleThreads() {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double elapsed_usec = chrono::duration<double, micro>(now - clock_sampled_).count();
+    clock_sampled_ = now;
+    for (auto &thread_clock : thread_clocks_) {
+        // The clock of a thread which has returned cannot be read
+        struct timespec time;
+        if (clock_gettime(thread_clock.first, &time) != 0) continue;
+        u_long cpu = static_cast<u_long>(time.tv_sec) * 1000000 + static_cast<u_long>(time.tv_nsec) / 1000;
+        if (elapsed_usec > 0) {
+            thread_cpu_.Record(static_cast<uint64_t>((cpu - thread_clock.second) * 1000000.0 / elapsed_usec));
+        }
+        thread_clock.second = cpu;
+    }
+}
+
+void Stats::SetCoordinator(Coordinator *coordinator) {
+    coordinator_ = coordinator;
+}
+
+void Stats::Snapshot(Metrics *metrics) const {
+    Collect(metrics);
+}
+
+bool Stats::Finished() {
+    lock_guard<mutex> lock(mtx_finished_);
+    return finished_;
+}
+
+// Count the result into the slot of the worker, which is written by no other thread
+void Stats::CountResult(const u_int worker_id, const RequestResult &result) {
+    MetricsSlot *slot = slots_[worker_id].get();
+
+    MetricsSlot::Add(&slot->error_curl, result.error_curl);
+    MetricsSlot::Add(&slot->error_http, result.error_http);
+    MetricsSlot::Add(&slot->error_partial, result.error_partial);
+    if (result.success) {
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            uint64_t phase = SecToUsec(result.time_phases[i]);
+            MetricsSlot::Add(&slot->time_phases[i], phase);
+            slot->phases[i].Record(phase);
+        }
+        MetricsSlot::Add(&slot->size_upload, result.size_upload);
+        MetricsSlot::Add(&slot->size_download, result.size_download);
+        MetricsSlot::Add(&slot->size_upload_decoded, result.size_upload_decoded);
+        MetricsSlot::Add(&slot->size_download_decoded, result.size_download_decoded);
+        MetricsSlot::Add(&slot->docs, result.docs);
+        MetricsSlot::Add(&slot->time_transfer, SecToUsec(result.time_transfer));
+        MetricsSlot::Add(&slot->time_response, SecToUsec(result.time_response));
+        slot->transfer.Record(SecToUsec(result.time_transfer));
+        slot->response.Record(SecToUsec(result.time_response));
+        if (result.time_took >= 0) {
+            MetricsSlot::Add(&slot->time_took, SecToUsec(result.time_took));
+            slot->took.Record(SecToUsec(result.time_took));
+        }
+        if (result.retries > 0) {
+            MetricsSlot::Add(&slot->time_retried, SecToUsec(result.time_response));
+            slot->retried.Record(SecToUsec(result.time_response));
+        }
+        MetricsSlot::Add(&slot->success, result.success);
+    }
+
+    if (!slot->queries.empty()) CountGroup(slot->queries[result.query].get(), result);
+    if (!slot->nodes.empty()) CountGroup(slot->nodes[result.node].get(), result);
+    if (result.step >= 0 && !slot->pages.empty()) CountGroup(slot->pages[result.step].get(), result);
+    if (result.session_end == SESSION_COMPLETED) MetricsSlot::Add(&slot->sessions, 1);
+    if (result.session_end == SESSION_FAILED) MetricsSlot::Add(&slot->sessions_failed, 1);
+}
+
+void Stats::CountAttempt(const u_int worker_id, const RequestResult &result) {
+    MetricsSlot *slot = slots_[worker_id].get();
+    MetricsSlot::Add(&slot->connects, result.connects);
+    if (result.status > 0) MetricsSlot::Add(&slot->statuses[min(result.status, STATUS_CODES - 1L)], 1);
+    if (result.curl_code > 0) MetricsSlot::Add(&slot->curl_errors[min(result.curl_code, CURL_CODES - 1)], 1);
+    MetricsSlot::Add(&slot->rejections, result.rejections);
+    if (result.retrying) MetricsSlot::Add(&slot->retries, 1);
+    if (result.retry_denied) MetricsSlot::Add(&slot->retries_denied, 1);
+}
+
+void Stats::CountGroup(GroupSlot *group, const RequestResult &result) {
+    MetricsSlot::Add(&group->error_curl, result.error_curl);
+    MetricsSlot::Add(&group->error_http, result.error_http);
+    MetricsSlot::Add(&group->error_partial, result.error_partial);
+    if (result.success) {
+        uint64_t latency = SecToUsec(options_->IsOpenLoop() ? result.time_response : result.time_transfer);
+        MetricsSlot::Add(&group->time_latency, latency);
+        group->latency.Record(latency);
+        MetricsSlot::Add(&group->success, result.success);
+    }
+}
+
+// Count how late an open-loop request is sent compared to its intended time
+void Stats::CountSchedule(const u_int worker_id, const double lag, const double interval) {
+    if (lag <= interval) return;
+    slots_[worker_id]->lag.Record(SecToUsec(lag));
+}
+
+void Stats::CountLateness(const u_int worker_id, const double lateness) {
+    slots_[worker_id]->lateness.Record(SecToUsec(max(lateness, 0.0)));
+    CountSchedule(worker_id, lateness, REPLAY_TOLERANCE_SEC);
+}
+
+bool Stats::IsCompressed() const {
+    return options_->gzip_request_ || options_->accept_encoding_;
+}
+
 void Stats::PrintLine(const string option, const u_int value) {
     stringstream msg;
     msg << setw(35) << right << option << ": " << setw(RESULT_WIDTH) << right << value << endl;
@@ -119,30 +623,288 @@ void Stats::PrintLine(const string option, const double value) {
     safe_cout(msg.str());
 }
 
+// Print latency percentiles of the histograms side by side
+void Stats::PrintPercentiles(const string &title, const vector<pair<string, const Histogram *>> &latencies) {
+    stringstream msg;
+    msg << setw(35) << right << title << ":";
+    for (auto &latency : latencies) msg << " " << setw(RESULT_WIDTH) << right << latency.first;
+    msg << endl;
+    for (int i = 0; i < 5; i++) {
+        string label = i < 4 ? PERCENTILE_LABELS[i] : "max";
+        msg << setw(35) << right << label << ":";
+        for (auto &latency : latencies) {
+            uint64_t value = i < 4 ? latency.second->ValueAtPercentile(PERCENTILES[i]) : latency.second->Max();
+            msg << " " << setw(RESULT_WIDTH) << right << fixed << setprecision(5) << UsecToSec(value);
+        }
+        msg << endl;
+    }
+    safe_cout(msg.str());
+}
+
+// Print a summary of every stage reached, warm-up included, with the level at the end of the stage
+void Stats::PrintStages() {
+    bool rate = options_->request_rate_ > 0;
+    stringstream msg;
+    msg << STAGES_HEADER << endl;
+    msg << setw(LABEL_WIDTH) << left << "Stage" << right << setw(PROGRESS_WIDTH) << "Sec"
+        << setw(PROGRESS_WIDTH) << "Threads";
+    if (rate) msg << setw(PROGRESS_WIDTH) << "Rate";
+    msg << setw(PROGRESS_WIDTH) << "Req/s" << setw(PROGRESS_WIDTH) << "Success" << setw(PROGRESS_WIDTH) << "Fail"
+        << setw(PROGRESS_WIDTH) << "HTTP>400" << setw(PROGRESS_WIDTH) << "Partial" << setw(PROGRESS_WIDTH) << "Average";
+    for (const char *label : PERCENTILE_LABELS) msg << setw(PROGRESS_WIDTH) << label;
+    msg << setw(PROGRESS_WIDTH) << "Max" << endl;
+
+    Metrics end;
+    Collect(&end);
+    for (size_t i = 0; i < stage_marks_.size() && i < options_->stages_.size(); i++) {
+        const Stage &stage = options_->stages_[i];
+        bool last = i + 1 >= stage_marks_.size();
+        Metrics metrics = last ? end : stage_marks_[i + 1];
+        metrics.Subtract(stage_marks_[i]);
+        double elapsed_sec = chrono::duration<double>((last ? clock_stop_ : stage_clocks_[i + 1]) -
+                                                      stage_clocks_[i]).count();
+
+        const Histogram &latency = rate ? metrics.response : metrics.transfer;
+        u_long time_latency = rate ? metrics.time_response : metrics.time_transfer;
+        double average = metrics.success > 0 ? UsecToSec(time_latency) / metrics.success : 0.0;
+        msg << setw(LABEL_WIDTH) << left << stage.label.substr(0, LABEL_WIDTH - 1) << right << fixed
+            << setprecision(1) << setw(PROGRESS_WIDTH) << elapsed_sec << setw(PROGRESS_WIDTH) << stage.threads;
+        if (rate) msg << setw(PROGRESS_WIDTH) << stage.rate;
+        msg << setw(PROGRESS_WIDTH) << (elapsed_sec > 0 ? metrics.success / elapsed_sec : 0.0)
+            << setw(PROGRESS_WIDTH) << metrics.success << setw(PROGRESS_WIDTH) << metrics.error_curl
+            << setw(PROGRESS_WIDTH) << metrics.error_http << setw(PROGRESS_WIDTH) << metrics.error_partial
+            << setprecision(4) << setw(PROGRESS_WIDTH) << average;
+        for (double percentile : PERCENTILES) {
+            msg << setw(PROGRESS_WIDTH) << UsecToSec(latency.ValueAtPercentile(percentile));
+        }
+        msg << setw(PROGRESS_WIDTH) << UsecToSec(latency.Max()) << endl;
+
+        if (options_->report_.IsOpen()) {
+            Record record("stage");
+            record.Add("label", stage.label);
+            record.Add("threads", static_cast<u_long>(stage.threads));
+            if (rate) record.Add("rate", stage.rate);
+            FillRecord(&record, metrics, elapsed_sec);
+            options_->report_.Write(record);
+        }
+    }
+    safe_cout(msg.str());
+}
+
+void Stats::PrintResponses(const Metrics &metrics) {
+    u_long attempts = 0;
+    for (u_long count : metrics.statuses) attempts += count;
+    for (u_long count : metrics.curl_errors) attempts += count;
+    if (attempts == 0) return;
+
+    stringstream msg;
+    msg << RESPONSES_HEADER << endl;
+    msg << setw(LABEL_WIDTH) << left << "Response" << right << setw(PROGRESS_WIDTH) << "Count"
+        << setw(PROGRESS_WIDTH) << "Percent" << endl;
+    for (int i = 0; i < STATUS_CODES; i++) {
+        if (metrics.statuses[i] == 0) continue;
+        msg << setw(LABEL_WIDTH) << left << ("HTTP " + to_string(i)) << right << setw(PROGRESS_WIDTH)
+            << metrics.statuses[i] << setw(PROGRESS_WIDTH) << fixed << setprecision(2)
+            << metrics.statuses[i] * 100.0 / attempts << endl;
+    }
+    for (int i = 0; i < CURL_CODES; i++) {
+        if (metrics.curl_errors[i] == 0) continue;
+        msg << setw(LABEL_WIDTH) << left << ("curl " + to_string(i)) << right << setw(PROGRESS_WIDTH)
+            << metrics.curl_errors[i] << setw(PROGRESS_WIDTH) << fixed << setprecision(2)
+            << metrics.curl_errors[i] * 100.0 / attempts << "  " << curl_easy_strerror(static_cast<CURLcode>(i))
+            << endl;
+    }
+    safe_cout(msg.str());
+}
+
+string Stats::Taxonomy(const Metrics &metrics) {
+    stringstream line;
+    for (int i = 400; i < STATUS_CODES; i++) {
+        if (metrics.statuses[i] > 0) line << (line.tellp() > 0 ? " " : "HTTP ") << i << "=" << metrics.statuses[i];
+    }
+    if (metrics.rejections > 0) line << (line.tellp() > 0 ? ", " : "") << "rejected " << metrics.rejections;
+    bool curl = false;
+    for (int i = 0; i < CURL_CODES; i++) {
+        if (metrics.curl_errors[i] == 0) continue;
+        line << (curl ? " " : (line.tellp() > 0 ? ", curl " : "curl ")) << i << "=" << metrics.curl_errors[i];
+        curl = true;
+    }
+    return line.str();
+}
+
+void Stats::AddProbe(const Probe &probe) {
+    probes_.push_back(probe);
+    if (options_->agent_) return;
+    const Histogram &latency = options_->IsOpenLoop() ? probe.metrics.response : probe.metrics.transfer;
+    stringstream msg;
+    msg << "Probe " << probes_.size() << ": " << probe.threads << " threads";
+    if (probe.rate > 0) msg << " at " << fixed << setprecision(1) << probe.rate << " requests/sec";
+    msg << ", " << fixed << setprecision(1)
+        << (probe.elapsed_sec > 0 ? probe.metrics.success / probe.elapsed_sec : 0.0) << " successful/sec, p99 "
+        << setprecision(4) << UsecToSec(latency.ValueAtPercentile(99.0)) << " sec, "
+        << (probe.passed ? "passed" : "failed") << endl;
+    safe_cout(msg.str());
+}
+
+const Probe *Stats::Capacity() const {
+    const Probe *capacity = nullptr;
+    for (const Probe &probe : probes_) {
+        if (!probe.passed) continue;
+        if (!capacity || probe.threads > capacity->threads || probe.rate > capacity->rate) capacity = &probe;
+    }
+    return capacity;
+}
+
+void Stats::PrintProbes() {
+    bool rate = options_->request_rate_ > 0;
+    stringstream msg;
+    msg << SEARCH_HEADER << endl;
+    msg << setw(LABEL_WIDTH) << left << "Probe" << right << setw(PROGRESS_WIDTH) << "Threads";
+    if (rate) msg << setw(PROGRESS_WIDTH) << "Rate";
+    msg << setw(PROGRESS_WIDTH) << "Req/s" << setw(PROGRESS_WIDTH) << "Errors%" << setw(PROGRESS_WIDTH) << "Average";
+    for (const char *label : PERCENTILE_LABELS) msg << setw(PROGRESS_WIDTH) << label;
+    msg << setw(PROGRESS_WIDTH) << "Max" << "  Objective" << endl;
+
+    // The curve in the order of the level, rather than of the search
+    vector<const Probe *> curve;
+    for (const Probe &probe : probes_) curve.push_back(&probe);
+    stable_sort(curve.begin(), curve.end(), [](const Probe *a, const Probe *b) {
+        return a->threads < b->threads || (a->threads == b->threads && a->rate < b->rate);
+    });
+    for (const Probe *probe : curve) {
+        const Metrics &metrics = probe->metrics;
+        const Histogram &latency = options_->IsOpenLoop() ? metrics.response : metrics.transfer;
+        u_long time_latency = options_->IsOpenLoop() ? metrics.time_response : metrics.time_transfer;
+        u_long failures = metrics.error_curl + metrics.error_http + metrics.error_partial;
+        u_long requests = metrics.success + failures;
+        double per_sec = probe->elapsed_sec > 0 ? metrics.success / probe->elapsed_sec : 0.0;
+        msg << setw(LABEL_WIDTH) << left << ("probe " + to_string(probe - &probes_[0] + 1)) << right
+            << setw(PROGRESS_WIDTH) << probe->threads << fixed << setprecision(1);
+        if (rate) msg << setw(PROGRESS_WIDTH) << probe->rate;
+        msg << setw(PROGRESS_WIDTH) << per_sec << setprecision(2) << setw(PROGRESS_WIDTH)
+            << (requests > 0 ? failures * 100.0 / requests : 0.0) << setprecision(4) << setw(PROGRESS_WIDTH)
+            << (metrics.success > 0 ? UsecToSec(time_latency) / metrics.success : 0.0);
+        for (double percentile : PERCENTILES) {
+            msg << setw(PROGRESS_WIDTH) << UsecToSec(latency.ValueAtPercentile(percentile));
+        }
+        msg << setw(PROGRESS_WIDTH) << UsecToSec(latency.Max()) << "  " << (probe->passed ? "passed" : "failed")
+            << endl;
+
+        if (options_->report_.IsOpen()) {
+            Record record("probe");
+            record.Add("threads", static_cast<u_long>(probe->threads));
+            if (rate) record.Add("rate", probe->rate);
+            record.Add("passed", string(probe->passed ? "true" : "false"));
+            FillRecord(&record, metrics, probe->elapsed_sec);
+            options_->report_.Write(record);
+        }
+    }
+    safe_cout(msg.str());
+
+    const Probe *capacity = Capacity();
+    if (!capacity) {
+        safe_cout("No probe met the objective " + options_->objective_ + "\n");
+        return;
+    }
+    Stats::PrintLine("Capacity (threads)", capacity->threads);
+    if (rate) Stats::PrintLine("Capacity (requests/sec)", capacity->rate);
+    Stats::PrintLine("Capacity successful requests/sec",
+                     capacity->elapsed_sec > 0 ? capacity->metrics.success / capacity->elapsed_sec : 0.0);
+}
+
+// Print a table of the counters and latency (sec) broken out by the labels
+vector<string> Stats::PageLabels() const {
+    vector<string> labels;
+    labels.push_back("open");
+    for (u_int p = 1; p <= options_->workload_.MaxPages(); p++) labels.push_back("page " + to_string(p));
+    labels.push_back("close");
+    return labels;
+}
+
+void Stats::PrintGroups(const string &header, const string &name, const vector<GroupMetrics> &groups,
+                        const vector<string> &labels) {
+    stringstream msg;
+    msg << header << endl;
+    msg << setw(LABEL_WIDTH) << left << name << right << setw(PROGRESS_WIDTH) << "Success"
+        << setw(PROGRESS_WIDTH) << "Fail" << setw(PROGRESS_WIDTH) << "HTTP>400" << setw(PROGRESS_WIDTH) << "Partial"
+        << setw(PROGRESS_WIDTH) << "Average";
+    for (const char *label : PERCENTILE_LABELS) msg << setw(PROGRESS_WIDTH) << label;
+    msg << setw(PROGRESS_WIDTH) << "Max" << endl;
+    for (size_t i = 0; i < groups.size(); i++) {
+        const GroupMetrics &group = groups[i];
+        double average = group.success > 0 ? UsecToSec(group.time_latency) / group.success : 0.0;
+        msg << setw(LABEL_WIDTH) << left << labels[i].substr(0, LABEL_WIDTH - 1) << right
+            << setw(PROGRESS_WIDTH) << group.success << setw(PROGRESS_WIDTH) << group.error_curl
+            << setw(PROGRESS_WIDTH) << group.error_http << setw(PROGRESS_WIDTH) << group.error_partial
+            << setw(PROGRESS_WIDTH) << fixed << setprecision(4) << average;
+        for (double percentile : PERCENTILES) {
+            msg << setw(PROGRESS_WIDTH) << UsecToSec(group.latency.ValueAtPercentile(percentile));
+        }
+        msg << setw(PROGRESS_WIDTH) << UsecToSec(group.latency.Max()) << endl;
+    }
+    safe_cout(msg.str());
+}
+
 void Stats::ShowProgressHeader() {
     stringstream msg;
     msg << setw(24) << left << "Timestamp" << " "
          << setw(PROGRESS_WIDTH) << right << "Success" << " " << setw(PROGRESS_WIDTH) << "Fail" << setw(PROGRESS_WIDTH)
-         << "HTTP>400"
-         << setw(PROGRESS_WIDTH) << "Upload" << setw(PROGRESS_WIDTH) << "Download" << setw(PROGRESS_WIDTH) << "Response"
-         << endl << PROGRESS_HEADER << endl;
+         << "HTTP>400" << setw(PROGRESS_WIDTH) << "Partial"
+         << setw(PROGRESS_WIDTH) << "Upload" << setw(PROGRESS_WIDTH) << "Download";
+    if (IsCompressed()) msg << setw(PROGRESS_WIDTH) << "Up-dec" << setw(PROGRESS_WIDTH) << "Down-dec";
+    msg << setw(PROGRESS_WIDTH) << "Response";
+    if (options_->IsOpenLoop()) msg << setw(PROGRESS_WIDTH) << "Intended";
+    msg << setw(PROGRESS_WIDTH) << "Took" << setw(PROGRESS_WIDTH) << "NewConn" << setw(PROGRESS_WIDTH) << "Setup"
+        << setw(PROGRESS_WIDTH) << "TTFB";
+    for (const char *label : PERCENTILE_LABELS) msg << setw(PROGRESS_WIDTH) << label;
+    msg << setw(PROGRESS_WIDTH) << "Max";
+    if (options_->bulk_docs_ > 0) msg << " " << setw(PROGRESS_WIDTH) << "Docs";
+    msg << setw(PROGRESS_WIDTH) << "CPU%" << setw(PROGRESS_WIDTH) << "Thread%" << setw(PROGRESS_WIDTH) << "CtxSw";
+    if (options_->retry_.IsEnabled()) msg << setw(PROGRESS_WIDTH) << "Retries";
+    msg << endl << PROGRESS_HEADER;
+    if (IsCompressed()) msg << PROGRESS_HEADER_DECODED;
+    if (options_->IsOpenLoop()) msg << PROGRESS_HEADER_CORRECTED;
+    msg << PROGRESS_HEADER_TOOK << PROGRESS_HEADER_PHASES << PROGRESS_HEADER_PERCENTILES;
+    if (options_->bulk_docs_ > 0) msg << PROGRESS_HEADER_DOCS;
+    msg << PROGRESS_HEADER_USAGE;
+    if (options_->retry_.IsEnabled()) msg << PROGRESS_HEADER_RETRIES;
+    msg << endl;
     safe_cout(msg.str());
 }
 
 Stats::Stats(Options *options_, mutex *mtx_for_cout_) : options_(options_), mtx_for_cout_(mtx_for_cout_) {
-    requests_ = 0;
-    success_ = 0;
-    error_curl_ = 0;
-    error_http_ = 0;
-    size_upload_ = 0;
-    size_download_ = 0;
-    time_transfer_ = 0;
-    wu_success_ = 0;
-    wu_error_curl_ = 0;
-    wu_error_http_ = 0;
-    wu_size_upload_ = 0;
-    wu_size_download_ = 0;
-    wu_time_transfer_ = 0;
+    for (u_int i = 0; i < options_->num_threads_; i++) {
+        slots_.push_back(unique_ptr<MetricsSlot>(new MetricsSlot()));
+        // Break out the queries only when there is a mix of them
+        if (options_->workload_.Size() > 1) {
+            for (size_t q = 0; q < options_->workload_.Size(); q++) {
+                slots_.back()->queries.push_back(unique_ptr<GroupSlot>(new GroupSlot()));
+            }
+        }
+        if (options_->nodes_.size() > 1) {
+            for (size_t n = 0; n < options_->nodes_.size(); n++) {
+                slots_.back()->nodes.push_back(unique_ptr<GroupSlot>(new GroupSlot()));
+            }
+        }
+        // The open, every page depth and the close of the sessions
+        if (options_->workload_.MaxPages() > 0) {
+            for (u_int p = 0; p < options_->workload_.MaxPages() + 2; p++) {
+                slots_.back()->pages.push_back(unique_ptr<GroupSlot>(new GroupSlot()));
+            }
+        }
+    }
+    // The CPU spent on parsing the options and loading the files is not part of the run
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        cpu_start_ = TimevalToUsec(usage.ru_utime) + TimevalToUsec(usage.ru_stime);
+        switches_voluntary_start_ = static_cast<u_long>(usage.ru_nvcsw);
+        switches_involuntary_start_ = static_cast<u_long>(usage.ru_nivcsw);
+    }
+    // Without warm-up, the results start from zero
+    if (options_->warmup_sec_ == 0) {
+        clock_warm_up_ = clock_start_;
+        warmed_up_ = true;
+    }
 }
 
 void Stats::safe_cout(const string msg) {
@@ -157,4 +919,16 @@ void Stats::safe_cerr(const string msg) {
 
 u_long Stats::CountRequest() {
     return requests_++;
-}
\ No newline at end of file
+}
+
+u_long Stats::Requests() const {
+    return requests_.load(memory_order_relaxed);
+}
+
+void Stats::Stop() {
+    stopped_.store(true, memory_order_relaxed);
+}
+
+bool Stats::Stopped() const {
+    return stopped_.load(memory_order_relaxed);
+}
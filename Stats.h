@@ -7,6 +7,10 @@
 
 #include <iostream>
 #include <sstream>
+#include <condition_variable>
+#include <thread>
+#include <ctime>
+#include <sys/resource.h>
 
 #ifdef __linux__
 #include <mutex>
@@ -14,6 +18,18 @@
 #endif
 
 #include "Options.h"
+#include "Metrics.h"
+
+class Coordinator;
+
+// Level held by a probe of the saturation search, with the counters of its steady state
+struct Probe {
+    u_int threads = 0;
+    double rate = 0.0;
+    double elapsed_sec = 0.0;
+    Metrics metrics;
+    bool passed = false;
+};
 
 using namespace std;
 
@@ -21,12 +37,40 @@ class Stats {
 public:
     Stats(Options *options_, mutex *mtx_for_cout_);
 
-    bool IsFinished() const;
-
     u_long CountRequest();
 
-    void CountResult(const int success, const int error_curl, const int error_http,
-                     const u_long size_upload, const u_long size_download, const double time_transfer);
+    // Requests taken so far
+    u_long Requests() const;
+
+    // End the run, the workers take no more requests
+    void Stop();
+
+    bool Stopped() const;
+
+    // Count the outcome of a request, once it is not sent again
+    void CountResult(const u_int worker_id, const RequestResult &result);
+
+    // Count every attempt of a request on the wire, by its status or error and whether it is retried
+    void CountAttempt(const u_int worker_id, const RequestResult &result);
+
+    void CountSchedule(const u_int worker_id, const double lag, const double interval);
+
+    // Count how late a replayed request is sent against its time in the log
+    void CountLateness(const u_int worker_id, const double lateness);
+
+    // Called once all the workers have returned
+    void Finish();
+
+    // Wait until all the workers have returned or the deadline comes, return true if finished
+    bool WaitUntilFinished(const chrono::steady_clock::time_point deadline);
+
+    // Take the counters at this moment as the start of the results
+    void MarkWarmUp();
+
+    // Take the counters at this moment as the start of the next stage of the profile
+    void MarkStage();
+
+    chrono::steady_clock::time_point ClockStart() const;
 
     void ShowProgressHeader();
 
@@ -34,51 +78,121 @@ public:
 
     void ShowResult();
 
+    // Compare the results with the baseline if one is given, return false on a regression
+    bool CheckBaseline();
+
+    // Take the counters from the agents of the coordinator in place of the local workers
+    void SetCoordinator(Coordinator *coordinator);
+
+    // Counters of all the workers so far, the start of the run is the origin
+    void Snapshot(Metrics *metrics) const;
+
+    bool Finished();
+
+    // Follow the CPU time of a worker thread, called before the Timer starts
+    void AddWorkerThread(thread *worker);
+
+    // Take the CPU each worker thread used since the previous sample, called by the Timer every interval
+    void SampleThreads();
+
+    // Keep a probe of the search for the results, called from the Timer thread
+    void AddProbe(const Probe &probe);
+
+    // Put the counters over elapsed seconds into a record of the report
+    void FillRecord(Record *record, const Metrics &metrics, const double elapsed_sec);
+
 private:
     Options *options_;
     mutex *mtx_for_cout_;
 
     // Keep start and stop time
     chrono::steady_clock::time_point clock_start_ = chrono::steady_clock::now();
+    chrono::steady_clock::time_point clock_warm_up_;
     chrono::steady_clock::time_point clock_stop_;
+    chrono::steady_clock::time_point clock_prev_ = clock_start_;
 
     // Finished processing
     bool finished_ = false;
-
-    // Counters from 0 sec
-    atomic_ulong requests_;
-    atomic_ulong success_;
-    atomic_ulong error_curl_;
-    atomic_ulong error_http_;
-    atomic_ulong size_upload_;
-    atomic_ulong size_download_;
-    atomic<double> time_transfer_{0.0};
-
-    // Counters after warm-up seconds
-    atomic_ulong wu_success_;
-    atomic_ulong wu_error_curl_;
-    atomic_ulong wu_error_http_;
-    atomic_ulong wu_size_upload_;
-    atomic_ulong wu_size_download_;
-    atomic<double> wu_time_transfer_;
-
-    u_long prev_success_ = 0;
-    u_long prev_error_curl_ = 0;
-    u_long prev_error_http_ = 0;
-    u_long prev_size_upload_ = 0;
-    u_long prev_size_download_ = 0;
-    double prev_time_transfer_ = 0;
-
-    // Function to add value to atomic double
-    void add_to_atomic_double(atomic<double> *var, double val) {
-        auto current = var->load();
-        while (!var->compare_exchange_weak(current, current + val));
-    }
+    mutex mtx_finished_;
+    condition_variable cv_finished_;
+
+    // Budget of requests shared by all the workers, kept on its own cache line
+    char padding_head_[CACHE_LINE_SIZE];
+    atomic_ulong requests_{0};
+    atomic_bool stopped_{false};
+    char padding_tail_[CACHE_LINE_SIZE];
+
+    // One slot for each worker
+    vector<unique_ptr<MetricsSlot>> slots_;
+    Coordinator *coordinator_ = nullptr;
+
+    // Merged counters at the previous progress and at the end of warm-up, only used by the Timer thread
+    Metrics prev_;
+    Metrics warm_up_;
+    bool warmed_up_ = false;
+    // Merged counters and time at the start of every stage reached
+    vector<Metrics> stage_marks_;
+    vector<chrono::steady_clock::time_point> stage_clocks_;
+    // Probes of the search in the order run
+    vector<Probe> probes_;
+
+    // CPU clocks of the worker threads with their usec at the previous sample, only used by the Timer thread
+    vector<pair<clockid_t, u_long>> thread_clocks_;
+    chrono::steady_clock::time_point clock_sampled_ = clock_start_;
+    AtomicHistogram thread_cpu_;
+    // CPUs the process may run on, and the CPU and context switches it had used before the start
+    u_int cpus_available_ = Affinity::AvailableCpus();
+    u_long cpu_start_ = 0;
+    u_long switches_voluntary_start_ = 0;
+    u_long switches_involuntary_start_ = 0;
+    // Intervals in which the client itself ran out of CPU
+    u_int saturated_intervals_ = 0;
+
+    // Summary of the results, kept for the baseline check
+    Record summary_{"summary"};
+
+    void Collect(Metrics *metrics) const;
+
+    // Add the CPU and context switches of this process since the start
+    void CollectUsage(Metrics *metrics) const;
+
+    // Count the result into the counters of its query or node
+    void CountGroup(GroupSlot *group, const RequestResult &result);
+
+    // Requests or responses are compressed, so that the decoded bytes differ from the wire
+    bool IsCompressed() const;
 
     void PrintLine(const string option, const u_int value);
 
     void PrintLine(const string option, double value);
 
+    void PrintPercentiles(const string &title, const vector<pair<string, const Histogram *>> &latencies);
+
+    void PrintStages();
+
+    // Print the attempts by HTTP status and by curl error
+    void PrintResponses(const Metrics &metrics);
+
+    // Counts of the HTTP errors, rejections and curl errors on a line, empty if there are none
+    static string Taxonomy(const Metrics &metrics);
+
+    // Print the latency curve of the search and the capacity found
+    void PrintProbes();
+
+    // Probe of the highest level meeting the objective, null if none did
+    const Probe *Capacity() const;
+
+    void FillGroupRecord(Record *record, const GroupMetrics &group, const double elapsed_sec);
+
+    void WriteGroups(const string &type, const vector<GroupMetrics> &groups, const vector<string> &labels,
+                     const double elapsed_sec);
+
+    // Steps of the sessions in the order of the page slots
+    vector<string> PageLabels() const;
+
+    void PrintGroups(const string &header, const string &name, const vector<GroupMetrics> &groups,
+                     const vector<string> &labels);
+
     void safe_cout(const string msg);
 
     void safe_cerr(const string msg);
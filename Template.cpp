@@ -0,0 +1,389 @@
+//
+// Request template compiled into literal and placeholder segments
+//
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+#include "Template.h"
+
+static const string TOKEN_RNUM_EX = "$RNUM(";
+static const string TOKEN_RNUM = "$RNUM";
+static const string TOKEN_RRANGE = "$RRANGE(";
+static const string TOKEN_RFLOAT = "$RFLOAT(";
+static const string TOKEN_RDATE = "$RDATE(";
+static const string TOKEN_UUID = "$UUID";
+static const string TOKEN_SEQ = "$SEQ";
+static const string TOKEN_GSEQ = "$GSEQ";
+static const string TOKEN_RDICT = "$RDICT";
+static const string TOKEN_SCROLL_ID = "$SCROLL_ID";
+static const string TOKEN_PIT_ID = "$PIT_ID";
+static const string TOKEN_SORT = "$SORT";
+
+// Decimals of $RFLOAT unless given, and at most
+static const int FLOAT_DECIMALS = 2;
+static const int MAX_FLOAT_DECIMALS = 9;
+static const long long POWERS_OF_TEN[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+                                          1000000000};
+
+// Sequence of $GSEQ over all the threads, a contended counter unlike the $SEQ of each thread
+static atomic<u_long> global_sequence{0};
+
+// Zero padded decimal of the given width
+static void PutDigits(char *p, int value, int width) {
+    for (int i = width - 1; i >= 0; i--, value /= 10) p[i] = static_cast<char>('0' + value % 10);
+}
+
+// Signed integer taking the whole string
+static bool ParseInteger(const string &text, long long *value) {
+    if (text.empty()) return false;
+    char *end;
+    *value = strtoll(text.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// Seconds with an optional unit of s, m, h or d, such as -7d
+static bool ParseOffset(string text, long long *sec) {
+    long long unit = 1;
+    if (!text.empty()) {
+        switch (text.back()) {
+            case 's': unit = 1; break;
+            case 'm': unit = 60; break;
+            case 'h': unit = 3600; break;
+            case 'd': unit = 86400; break;
+            default: unit = 0;
+        }
+        if (unit > 0) text.pop_back(); else unit = 1;
+    }
+    if (!ParseInteger(text, sec)) return false;
+    *sec *= unit;
+    return true;
+}
+
+// Split the source into segments, placeholders are recognized in the same way as the former
+// ReplaceRNUMEx, ReplaceRNUM and ReplaceRDICT did
+void Template::Compile(const string &source, const Dictionary *dict, bool session) {
+    source_ = source;
+    dict_ = dict;
+    segments_.clear();
+
+    bool use_dict = dict_ != nullptr && dict_->Size() > 0;
+    size_t literal_start = 0;
+    size_t pos = source_.find('$');
+
+    while (pos != string::npos) {
+        if (source_.compare(pos, TOKEN_RNUM_EX.size(), TOKEN_RNUM_EX) == 0) {
+            size_t e_pos = source_.find(')', pos);
+            if (e_pos != string::npos) {
+                AddLiteral(literal_start, pos - literal_start);
+                int m = atoi(source_.substr(pos + TOKEN_RNUM_EX.size(), e_pos - pos - TOKEN_RNUM_EX.size()).c_str());
+                // $RNUM(0) or less is replaced with an empty string
+                if (m > 0) segments_.push_back(Segment(RNUM_EX, 0, 0, static_cast<u_long>(m)));
+                literal_start = e_pos + 1;
+                pos = source_.find('$', literal_start);
+                continue;
+            }
+        }
+        // Generators resolved here into a segment, such as $RRANGE(1,10)
+        Segment generator(LITERAL, 0, 0, 0);
+        size_t end = string::npos;
+        if (source_.compare(pos, TOKEN_RRANGE.size(), TOKEN_RRANGE) == 0) {
+            generator.type = RRANGE;
+            end = ParseArguments(pos, TOKEN_RRANGE, &generator);
+        } else if (source_.compare(pos, TOKEN_RFLOAT.size(), TOKEN_RFLOAT) == 0) {
+            generator.type = RFLOAT;
+            end = ParseArguments(pos, TOKEN_RFLOAT, &generator);
+        } else if (source_.compare(pos, TOKEN_RDATE.size(), TOKEN_RDATE) == 0) {
+            generator.type = RDATE;
+            end = ParseArguments(pos, TOKEN_RDATE, &generator);
+        } else if (source_.compare(pos, TOKEN_UUID.size(), TOKEN_UUID) == 0) {
+            generator.type = UUID;
+            end = pos + TOKEN_UUID.size();
+        } else if (source_.compare(pos, TOKEN_SEQ.size(), TOKEN_SEQ) == 0) {
+            generator.type = SEQ;
+            end = pos + TOKEN_SEQ.size();
+        } else if (source_.compare(pos, TOKEN_GSEQ.size(), TOKEN_GSEQ) == 0) {
+            generator.type = GSEQ;
+            end = pos + TOKEN_GSEQ.size();
+        }
+        if (end != string::npos) {
+            AddLiteral(literal_start, pos - literal_start);
+            segments_.push_back(generator);
+            literal_start = end;
+            pos = source_.find('$', literal_start);
+            continue;
+        }
+        if (source_.compare(pos, TOKEN_RNUM.size(), TOKEN_RNUM) == 0) {
+            AddLiteral(literal_start, pos - literal_start);
+            segments_.push_back(Segment(RNUM, 0, 0, 256));
+            literal_start = pos + TOKEN_RNUM.size();
+            pos = source_.find('$', literal_start);
+            continue;
+        }
+        if (use_dict && source_.compare(pos, TOKEN_RDICT.size(), TOKEN_RDICT) == 0) {
+            AddLiteral(literal_start, pos - literal_start);
+            segments_.push_back(Segment(RDICT, 0, 0, 0));
+            literal_start = pos + TOKEN_RDICT.size();
+            pos = source_.find('$', literal_start);
+            continue;
+        }
+        if (session) {
+            const string *token = nullptr;
+            SegmentType type = LITERAL;
+            if (source_.compare(pos, TOKEN_SCROLL_ID.size(), TOKEN_SCROLL_ID) == 0) {
+                token = &TOKEN_SCROLL_ID;
+                type = SCROLL_ID;
+            } else if (source_.compare(pos, TOKEN_PIT_ID.size(), TOKEN_PIT_ID) == 0) {
+                token = &TOKEN_PIT_ID;
+                type = PIT_ID;
+            } else if (source_.compare(pos, TOKEN_SORT.size(), TOKEN_SORT) == 0) {
+                token = &TOKEN_SORT;
+                type = SORT;
+            }
+            if (token) {
+                AddLiteral(literal_start, pos - literal_start);
+                segments_.push_back(Segment(type, 0, 0, 0));
+                literal_start = pos + token->size();
+                pos = source_.find('$', literal_start);
+                continue;
+            }
+        }
+        pos = source_.find('$', pos + 1);
+    }
+    AddLiteral(literal_start, source_.size() - literal_start);
+}
+
+size_t Template::ParseArguments(size_t pos, const string &token, Segment *segment) const {
+    size_t start = pos + token.size();
+    size_t end = source_.find(')', start);
+    if (end == string::npos) return string::npos;
+    vector<string> arguments;
+    stringstream items(source_.substr(start, end - start));
+    for (string item; getline(items, item, ',');) {
+        size_t first = item.find_first_not_of(' ');
+        size_t last = item.find_last_not_of(' ');
+        arguments.push_back(first == string::npos ? string() : item.substr(first, last - first + 1));
+    }
+    if (arguments.size() < 2 || arguments.size() > 3) return string::npos;
+
+    switch (segment->type) {
+        case RRANGE: {
+            // Both ends are included
+            long long low;
+            long long high;
+            if (arguments.size() != 2 || !ParseInteger(arguments[0], &low) || !ParseInteger(arguments[1], &high) ||
+                low > high) {
+                return string::npos;
+            }
+            segment->base = low;
+            segment->modulo = static_cast<u_long>(static_cast<unsigned long long>(high) -
+                                                  static_cast<unsigned long long>(low) + 1);
+            break;
+        }
+        case RFLOAT: {
+            char *low_end;
+            char *high_end;
+            double low = strtod(arguments[0].c_str(), &low_end);
+            double high = strtod(arguments[1].c_str(), &high_end);
+            long long decimals = FLOAT_DECIMALS;
+            if (arguments[0].empty() || arguments[1].empty() || *low_end != '\0' || *high_end != '\0' ||
+                low > high || (arguments.size() == 3 && !ParseInteger(arguments[2], &decimals)) || decimals < 0 ||
+                decimals > MAX_FLOAT_DECIMALS) {
+                return string::npos;
+            }
+            segment->low = low;
+            segment->width = high - low;
+            segment->precision = static_cast<int>(decimals);
+            break;
+        }
+        case RDATE: {
+            // Offsets from the time of the request, so that the window rolls with the run
+            long long from;
+            long long to;
+            if (!ParseOffset(arguments[0], &from) || !ParseOffset(arguments[1], &to) || from > to) {
+                return string::npos;
+            }
+            segment->precision = DATE_TIME;
+            if (arguments.size() == 3) {
+                if (arguments[2] == "date") {
+                    segment->precision = DATE;
+                } else if (arguments[2] == "epoch_millis") {
+                    segment->precision = EPOCH_MILLIS;
+                } else if (arguments[2] != "date_time") {
+                    return string::npos;
+                }
+            }
+            if (segment->precision == EPOCH_MILLIS) {
+                segment->base = from * 1000;
+                segment->modulo = static_cast<u_long>((to - from) * 1000 + 1);
+            } else {
+                segment->base = from;
+                segment->modulo = static_cast<u_long>(to - from + 1);
+            }
+            break;
+        }
+        default:
+            return string::npos;
+    }
+    return end + 1;
+}
+
+void Template::Render(Random *random, u_long *sequence, string *out, const SessionValues *values) const {
+    out->clear();
+    RenderAppend(random, sequence, out, values);
+}
+
+void Template::RenderAppend(Random *random, u_long *sequence, string *out, const SessionValues *values) const {
+    for (const Segment &segment : segments_) {
+        switch (segment.type) {
+            case LITERAL:
+                out->append(source_, segment.offset, segment.length);
+                break;
+            case RNUM:
+            case RNUM_EX:
+                AppendNumber(out, random->Uniform(segment.modulo));
+                break;
+            case RRANGE: {
+                u_long draw = segment.modulo > 0 ? random->Uniform(segment.modulo) : random->Next();
+                AppendInteger(out, static_cast<long long>(static_cast<unsigned long long>(segment.base) + draw));
+                break;
+            }
+            case RFLOAT:
+                AppendFixed(out, segment.low + segment.width * random->NextDouble(), segment.precision);
+                break;
+            case RDATE: {
+                long long now = chrono::duration_cast<chrono::milliseconds>(
+                        chrono::system_clock::now().time_since_epoch()).count();
+                long long draw = static_cast<long long>(random->Uniform(segment.modulo));
+                if (segment.precision == EPOCH_MILLIS) {
+                    AppendInteger(out, now + segment.base + draw);
+                } else {
+                    AppendDate(out, (now / 1000 + segment.base + draw) * 1000, segment.precision);
+                }
+                break;
+            }
+            case UUID:
+                AppendUuid(out, random);
+                break;
+            case SEQ:
+                AppendNumber(out, (*sequence)++);
+                break;
+            case GSEQ:
+                AppendNumber(out, global_sequence.fetch_add(1, memory_order_relaxed));
+                break;
+            case RDICT:
+                dict_->AppendTerm(random, out);
+                break;
+            case SCROLL_ID:
+                if (values) out->append(values->scroll_id);
+                break;
+            case PIT_ID:
+                if (values) out->append(values->pit_id);
+                break;
+            case SORT:
+                if (values) out->append(values->sort);
+                break;
+        }
+    }
+}
+
+bool Template::IsStatic() const {
+    for (const Segment &segment : segments_) {
+        if (segment.type != LITERAL) return false;
+    }
+    return true;
+}
+
+const string &Template::Source() const {
+    return source_;
+}
+
+void Template::AddLiteral(size_t offset, size_t length) {
+    if (length == 0) return;
+    segments_.push_back(Segment(LITERAL, offset, length, 0));
+}
+
+// Append a decimal number without a temporary string
+void Template::AppendNumber(string *out, u_long value) {
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    do {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    out->append(p, buf + sizeof(buf) - p);
+}
+
+void Template::AppendInteger(string *out, long long value) {
+    if (value < 0) {
+        out->push_back('-');
+        AppendNumber(out, static_cast<u_long>(0) - static_cast<u_long>(value));
+        return;
+    }
+    AppendNumber(out, static_cast<u_long>(value));
+}
+
+void Template::AppendFixed(string *out, double value, int decimals) {
+    double scaled = value * POWERS_OF_TEN[decimals];
+    // Beyond the integers of 64 bits, printf takes over
+    if (!(fabs(scaled) < 9e18)) {
+        char buf[64];
+        int length = snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        if (length > 0) out->append(buf, min(static_cast<size_t>(length), sizeof(buf) - 1));
+        return;
+    }
+    long long rounded = llround(scaled);
+    if (rounded < 0) {
+        out->push_back('-');
+        rounded = -rounded;
+    }
+    AppendNumber(out, static_cast<u_long>(rounded / POWERS_OF_TEN[decimals]));
+    if (decimals == 0) return;
+    out->push_back('.');
+    u_long fraction = static_cast<u_long>(rounded % POWERS_OF_TEN[decimals]);
+    for (int i = decimals - 1; i >= 0; i--) {
+        out->push_back(static_cast<char>('0' + fraction / POWERS_OF_TEN[i] % 10));
+    }
+}
+
+// 2024-05-01T12:00:00Z or 2024-05-01 in UTC
+void Template::AppendDate(string *out, long long msec, int format) {
+    time_t sec = static_cast<time_t>(msec / 1000);
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+    // Digits written in place, strftime takes the locale on every call
+    char buf[20];
+    PutDigits(buf, tm.tm_year + 1900, 4);
+    buf[4] = '-';
+    PutDigits(buf + 5, tm.tm_mon + 1, 2);
+    buf[7] = '-';
+    PutDigits(buf + 8, tm.tm_mday, 2);
+    buf[10] = 'T';
+    PutDigits(buf + 11, tm.tm_hour, 2);
+    buf[13] = ':';
+    PutDigits(buf + 14, tm.tm_min, 2);
+    buf[16] = ':';
+    PutDigits(buf + 17, tm.tm_sec, 2);
+    buf[19] = 'Z';
+    out->append(buf, format == DATE ? 10 : sizeof(buf));
+}
+
+// Version 4 of RFC 4122, drawn from the random numbers of the thread
+void Template::AppendUuid(string *out, Random *random) {
+    static const char HEX[] = "0123456789abcdef";
+    uint64_t high = (random->Next() & 0xffffffffffff0fffULL) | 0x0000000000004000ULL;
+    uint64_t low = (random->Next() & 0x3fffffffffffffffULL) | 0x8000000000000000ULL;
+    char buf[36];
+    size_t p = 0;
+    for (int i = 0; i < 32; i++) {
+        if (i == 8 || i == 12 || i == 16 || i == 20) buf[p++] = '-';
+        uint64_t half = i < 16 ? high : low;
+        buf[p++] = HEX[(half >> (60 - (i % 16) * 4)) & 0xf];
+    }
+    out->append(buf, sizeof(buf));
+}
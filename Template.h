@@ -0,0 +1,89 @@
+//
+// Request template compiled into literal and placeholder segments
+//
+
+#ifndef ESPERF_TEMPLATE_H
+#define ESPERF_TEMPLATE_H
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "Random.h"
+#include "Dictionary.h"
+
+using namespace std;
+
+// Values taken from the previous response of a session, in place of $SCROLL_ID, $PIT_ID and $SORT
+struct SessionValues {
+    string scroll_id;
+    string pit_id;
+    string sort;
+};
+
+class Template {
+public:
+    // Compile the source string, $RDICT is only a placeholder when the dictionary has terms, and the values of a
+    // session only in the requests of one. A placeholder with arguments it cannot take is left as it is
+    void Compile(const string &source, const Dictionary *dict, bool session = false);
+
+    // Render into the buffer, which keeps its capacity between calls. The random numbers and the $SEQ sequence
+    // are those of the rendering thread
+    void Render(Random *random, u_long *sequence, string *out, const SessionValues *values = nullptr) const;
+
+    // Render after the current contents of the buffer
+    void RenderAppend(Random *random, u_long *sequence, string *out, const SessionValues *values = nullptr) const;
+
+    // True if rendering always gives the same string
+    bool IsStatic() const;
+
+    const string &Source() const;
+
+private:
+    enum SegmentType { LITERAL, RNUM, RNUM_EX, RRANGE, RFLOAT, RDATE, UUID, SEQ, GSEQ, RDICT, SCROLL_ID, PIT_ID, SORT };
+
+    // Formats of $RDATE
+    enum DateFormat { DATE_TIME, DATE, EPOCH_MILLIS };
+
+    // Arguments are resolved at the compile, so that rendering only draws the numbers
+    struct Segment {
+        SegmentType type;
+        size_t offset;
+        size_t length;
+        // Number of values to draw from, 0 for all those of 64 bits
+        u_long modulo;
+        // Lowest value of $RRANGE, and the seconds from now, or msec for EPOCH_MILLIS, of $RDATE
+        long long base = 0;
+        // Range of $RFLOAT
+        double low = 0.0;
+        double width = 0.0;
+        // Decimals of $RFLOAT, or the DateFormat of $RDATE
+        int precision = 0;
+
+        Segment(SegmentType type, size_t offset, size_t length, u_long modulo)
+            : type(type), offset(offset), length(length), modulo(modulo) {}
+    };
+
+    string source_;
+    vector<Segment> segments_;
+    const Dictionary *dict_ = nullptr;
+
+    void AddLiteral(size_t offset, size_t length);
+
+    // Read the arguments of a placeholder at pos, such as $RRANGE(1,10), into the segment and return the position
+    // after it, or npos if the arguments do not fit
+    size_t ParseArguments(size_t pos, const string &token, Segment *segment) const;
+
+    static void AppendNumber(string *out, u_long value);
+
+    static void AppendInteger(string *out, long long value);
+
+    // Append with the given decimals, rounded, without a temporary string
+    static void AppendFixed(string *out, double value, int decimals);
+
+    static void AppendDate(string *out, long long msec, int format);
+
+    static void AppendUuid(string *out, Random *random);
+};
+
+#endif //ESPERF_TEMPLATE_H
@@ -6,12 +6,71 @@
 #include "Timer.h"
 
 void Timer::Start() {
-    stats_->ShowProgressHeader();
+    if (!options_->timer_cpus_.empty()) Affinity::PinCurrentThread(options_->timer_cpus_);
+
+    // An agent leaves the progress to its coordinator
+    bool show = !options_->agent_;
+    if (show) stats_->ShowProgressHeader();
+
+    chrono::steady_clock::time_point clock_start = stats_->ClockStart();
+    chrono::steady_clock::time_point clock_warm_up = clock_start + chrono::seconds(options_->warmup_sec_);
+    chrono::steady_clock::time_point next_progress = clock_start + chrono::seconds(options_->interval_sec_);
+    bool warming_up = options_->warmup_sec_ > 0;
+
+    // End of the run, when a duration is given
+    chrono::steady_clock::time_point clock_stop = clock_start + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(options_->duration_sec_));
+    bool running = options_->duration_sec_ > 0;
+
+    // The first stage starts with the run
+    size_t stage = profile_->Update(0.0);
+    if (!options_->stages_.empty()) stats_->MarkStage();
+
     while (true){
-        this_thread::sleep_for(chrono::seconds(options_->interval_sec_));
-        stats_->ShowProgress();
-        if (stats_->IsFinished()) break;
+        // Wake up at the end of warm-up as well, so that the results start exactly there
+        chrono::steady_clock::time_point deadline = next_progress;
+        if (warming_up && clock_warm_up < deadline) deadline = clock_warm_up;
+        if (running && clock_stop < deadline) deadline = clock_stop;
+
+        // and whenever the load level moves
+        double elapsed_sec = chrono::duration<double>(chrono::steady_clock::now() - clock_start).count();
+        double next_change = profile_->NextChange(elapsed_sec);
+        if (next_change >= 0) {
+            chrono::steady_clock::time_point clock_change = clock_start +
+                    chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(next_change));
+            if (clock_change < deadline) deadline = clock_change;
+        }
+        if (search_ && search_->NextChange() < deadline) deadline = search_->NextChange();
+
+        bool finished = stats_->WaitUntilFinished(deadline);
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+        if (!finished) {
+            size_t current = profile_->Update(chrono::duration<double>(now - clock_start).count());
+            for (; stage < current; stage++) stats_->MarkStage();
+            // The run ends with the search
+            if (search_ && !search_->Update(now)) stats_->Stop();
+        }
+        if (running && now >= clock_stop) {
+            stats_->Stop();
+            running = false;
+        }
+        if (warming_up && now >= clock_warm_up && !finished) {
+            stats_->MarkWarmUp();
+            warming_up = false;
+        }
+        if (finished) {
+            if (show) stats_->ShowProgress();
+            break;
+        }
+        if (now >= next_progress) {
+            // An agent samples its threads as well, for the coordinator to see
+            stats_->SampleThreads();
+            if (show) stats_->ShowProgress();
+            next_progress += chrono::seconds(options_->interval_sec_);
+        }
     }
 }
 
-Timer::Timer(Stats *stats, Options *options) : stats_(stats), options_(options) {}
+Timer::Timer(Stats *stats, Options *options, Profile *profile, Search *search)
+        : stats_(stats), options_(options), profile_(profile), search_(search) {}
@@ -10,18 +10,23 @@
 
 #include "Options.h"
 #include "Stats.h"
+#include "Profile.h"
+#include "Search.h"
 
 using namespace std;
 
 class Timer {
 public:
-    Timer(Stats *stats, Options *options);
+    Timer(Stats *stats, Options *options, Profile *profile, Search *search);
 
     void Start();
 
 private:
     Stats *stats_;
     Options *options_;
+    Profile *profile_;
+    // Moves the level in place of the stages, null unless the workers run here
+    Search *search_;
 };
 
 #endif //ESPERF_TIMER_H
@@ -8,11 +8,37 @@
 
 //Worker::Worker(Stats *stats, Options *options) : stats_(stats), options_(options) {}
 
-Worker::Worker(Stats *stats_, Options *options_, mutex *mtx_for_cout_) : stats_(stats_), options_(options_),
-                                                                         mtx_for_cout_(mtx_for_cout_) {}
+Worker::Worker(Stats *stats_, Options *options_, Balancer *balancer_, Profile *profile_, mutex *mtx_for_cout_,
+               u_int id_)
+        : stats_(stats_),
+          options_(options_),
+          balancer_(balancer_),
+          profile_(profile_),
+          mtx_for_cout_(mtx_for_cout_),
+          id_(id_),
+          node_cursor_(id_),
+          open_loop_(options_->IsOpenLoop()) {
+    // Every thread draws its own reproducible sequence
+    random_.Seed(options_->seed_ + id_);
+    retry_budget_ = RetryBudget(options_->retry_.BudgetPercent());
+
+    // Split the rate across the threads, with their send times interleaved
+    if (options_->replay_.IsOpen()) {
+        replay_ = &options_->replay_;
+    } else if (open_loop_) {
+        scheduler_ = Scheduler(options_->request_rate_ / options_->num_threads_,
+                               static_cast<double>(id_) / options_->num_threads_);
+    }
+}
 
 void Worker::Run() {
-
+    // Pinned before anything is allocated, so that the memory of the thread is on the NUMA node of its CPU
+    if (!options_->worker_cpus_.empty()) {
+        u_int cpu = options_->worker_cpus_[id_ % options_->worker_cpus_.size()];
+        if (!Affinity::PinCurrentThread(vector<u_int>(1, cpu))) {
+            safe_cerr("Warning: cannot pin worker " + to_string(id_) + " to CPU " + to_string(cpu) + "\n");
+        }
+    }
 
     // Verbose output
     if(options_->verbose_){
@@ -21,155 +47,755 @@ void Worker::Run() {
         safe_cout(msg_start.str());
     }
 
-    // init easy curl
-    CURL *curl = curl_easy_init();
+    // Set headers
+    if (options_->bulk_docs_ > 0) {
+        slist_ = curl_slist_append(slist_, "Content-Type: application/x-ndjson");
+    } else {
+        slist_ = curl_slist_append(slist_, "Content-Type: application/json");
+    }
+    if (options_->gzip_request_) slist_ = curl_slist_append(slist_, "Content-Encoding: gzip");
 
-    if (curl) {
-        CURLcode cr;
-        FILE *f;
+    // init easy curl, one handle for each concurrent request
+    transfers_.resize(options_->num_connections_);
+    bool initialized = true;
+    for (Transfer &transfer : transfers_) {
+        initialized = InitTransfer(&transfer) && initialized;
+    }
 
-        // Do not show the response unless verbose logging
-        if (!options_->verbose_) {
-            f = fopen("/dev/null", "wb");
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, f);
+    if (initialized) {
+        scheduler_.Start(chrono::steady_clock::now());
+        if (options_->num_connections_ > 1) {
+            RunMulti();
+        } else {
+            RunEasy();
         }
+    }
 
-        // Set the method explicitly
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, options_->http_method_.c_str());
+    for (Transfer &transfer : transfers_) {
+        if (transfer.curl) curl_easy_cleanup(transfer.curl);
+    }
+    curl_slist_free_all(slist_);
+}
+
+void Worker::RunEasy() {
+    Transfer *transfer = &transfers_[0];
+
+    while (WaitUntilActive()) {
+        ApplyLevel(chrono::steady_clock::now());
+        if (!TakeRequest()) break;
+        PrepareRequest(transfer);
 
-        // Capture HTTP errors
-        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        // Wait for the send time in the open-loop mode
+        if (open_loop_ && !SleepUntil(NextSendTime())) break;
+        ScheduleRequest(transfer, chrono::steady_clock::now());
 
-        // Enable basic auth
-        if (!options_->http_user_.empty()) {
-            curl_easy_setopt(curl, CURLOPT_USERPWD, options_->http_user_.c_str());
+        // Perform a request, and again after a backoff while the policy retries it
+        CURLcode cr = curl_easy_perform(transfer->curl);
+        while (CountResult(transfer, cr)) {
+            if (!SleepUntil(transfer->retry_at)) {
+                GiveUp(transfer);
+                break;
+            }
+            PrepareRetry(transfer);
+            cr = curl_easy_perform(transfer->curl);
         }
+    }
+}
 
-        // Set headers
-        struct curl_slist *slist;
-        slist = curl_slist_append(slist, "Content-Type: application/json");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
+void Worker::RunMulti() {
+    CURLM *multi = curl_multi_init();
+    if (!multi) return;
+
+    // Keep a connection for every transfer to every node, unless the pool is capped
+    long nodes = static_cast<long>(max(balancer_->Size(), static_cast<size_t>(1)));
+    if (options_->max_connections_ > 0) {
+        // Transfers beyond the cap wait for a connection instead of opening one
+        curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, static_cast<long>(options_->max_connections_));
+        curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(options_->max_connections_));
+    } else {
+        curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, static_cast<long>(options_->num_connections_) * nodes);
+    }
 
-        while(stats_->CountRequest() < options_->num_recurrence_) {
-            // Supply random numbers and strings
-            string url = ReplaceRNUMEx(options_->request_url_);
-            url = ReplaceRNUM(url);
-            string body = ReplaceRNUMEx(options_->request_body_);
-            body = ReplaceRNUM(body);
-            if (options_->dict_.size() > 0) {
-                url = ReplaceRDICT(url);
-                body = ReplaceRDICT(body);
+    // Multiplex the transfers over HTTP/2 connections
+    if (options_->curl_http_version_ != CURL_HTTP_VERSION_1_1) {
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        if (options_->max_streams_ > 0) {
+            curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, static_cast<long>(options_->max_streams_));
+        }
+    }
+
+    vector<Transfer *> idle;
+    for (Transfer &transfer : transfers_) idle.push_back(&transfer);
+    // Failed requests waiting for their backoff to be sent again
+    vector<Transfer *> backoff;
+    int in_flight = 0;
+    bool exhausted = false;
+
+    while (true) {
+        // Send the retries due first, they do not take a request out of the budget
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        chrono::steady_clock::time_point next_retry = chrono::steady_clock::time_point::max();
+        for (size_t i = 0; i < backoff.size();) {
+            Transfer *transfer = backoff[i];
+            if (stats_->Stopped()) {
+                GiveUp(transfer);
+                idle.push_back(transfer);
+            } else if (transfer->retry_at <= now) {
+                PrepareRetry(transfer);
+                curl_multi_add_handle(multi, transfer->curl);
+                in_flight++;
+            } else {
+                next_retry = min(next_retry, transfer->retry_at);
+                i++;
+                continue;
+            }
+            backoff[i] = backoff.back();
+            backoff.pop_back();
+        }
+
+        // Start requests while a transfer is free and, in the open-loop mode, the send time has come
+        bool active = IsActive();
+        if (active) ApplyLevel(now);
+        while (active && !exhausted && !idle.empty() && (!open_loop_ || NextSendTime() <= now)) {
+            if (!TakeRequest()) {
+                exhausted = true;
+                break;
+            }
+            Transfer *transfer = idle.back();
+            idle.pop_back();
+            PrepareRequest(transfer);
+            ScheduleRequest(transfer, now);
+            curl_multi_add_handle(multi, transfer->curl);
+            in_flight++;
+        }
+
+        // A send time far ahead, such as across a gap in the log, is not waited for once the run is stopped
+        if (stats_->Stopped()) exhausted = true;
+        if (exhausted && in_flight == 0 && backoff.empty()) break;
+
+        // Nothing to drive until the next send time or retry, or until the stage runs this thread again
+        if (in_flight == 0) {
+            if (!backoff.empty()) {
+                chrono::steady_clock::time_point wake = min(next_retry, now + chrono::milliseconds(100));
+                if (active && !exhausted && !idle.empty() && open_loop_) wake = min(wake, NextSendTime());
+                this_thread::sleep_until(wake);
+            } else if (!active) {
+                if (!WaitUntilActive()) break;
+            } else {
+                this_thread::sleep_until(min(NextSendTime(), now + chrono::milliseconds(100)));
             }
+            continue;
+        }
 
-            if(options_->verbose_){
-                stringstream msg_url;
-                msg_url << this_thread::get_id() << " URL: " << url << endl;
-                safe_cout(msg_url.str());
-                stringstream msg_body;
-                msg_body << this_thread::get_id() << " Body: " << body << endl;
-                safe_cout(msg_body.str());
+        int running;
+        CURLMcode mc = curl_multi_perform(multi, &running);
+
+        // Collect completed transfers and free them for the next requests
+        CURLMsg *msg;
+        int msgs_left;
+        while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            Transfer *transfer;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+            CURLcode cr = msg->data.result;
+            curl_multi_remove_handle(multi, transfer->curl);
+            in_flight--;
+            if (CountResult(transfer, cr)) {
+                backoff.push_back(transfer);
+            } else {
+                idle.push_back(transfer);
             }
+        }
+
+        if (mc != CURLM_OK) {
+            stringstream msg_error;
+            msg_error << "Error: curl_multi_perform() returned (" << mc << ") " << curl_multi_strerror(mc) << endl;
+            safe_cerr(msg_error.str());
+            break;
+        }
 
-            // Set the URL and the body
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, body.size());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
-
-            // Set timeout
-            curl_easy_setopt(curl, CURLOPT_TIMEOUT, options_->timeout_sec_);
-
-            // Perform a request
-            cr = curl_easy_perform(curl);
-
-            stringstream msg_response;
-
-            // curl and HTTP errors
-            switch (cr) {
-                case CURLE_OK:
-                    long sizeUpload;
-                    double sizeDownload;
-                    long sizeReceivedHeader;
-                    double transferTime;
-                    curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &sizeUpload);
-                    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &sizeDownload);
-                    curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &sizeReceivedHeader);
-                    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &transferTime);
-                    stats_->CountResult(1, 0, 0, sizeUpload, (u_int) (sizeDownload + sizeReceivedHeader),
-                                        transferTime);
-                    break;
-                case CURLE_HTTP_RETURNED_ERROR:
-                    long http_response_code;
-                    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_response_code);
-                    msg_response << "Error: HTTP response (" << http_response_code << ")" << endl;
-                    safe_cerr(msg_response.str());
-                    stats_->CountResult(0, 0, 1, 0, 0, 0);
-                    break;
-                default:
-                    msg_response << "Error: curl_easy_perform() returned (" << cr << ") " << curl_easy_strerror(cr) << endl;
-                    safe_cerr(msg_response.str());
-                    stats_->CountResult(0, 1, 0, 0, 0, 0);
+        // Wake up on socket activity, or for the next send time when a transfer is free
+        int timeout_ms = 1000;
+        if (active && !idle.empty() && !exhausted) {
+            long until_next = 0;
+            if (open_loop_) {
+                until_next = chrono::duration_cast<chrono::milliseconds>(
+                        NextSendTime() - chrono::steady_clock::now()).count();
             }
+            timeout_ms = static_cast<int>(max(0L, min(until_next, 1000L)));
+        }
+        if (!backoff.empty()) {
+            long until_retry = chrono::duration_cast<chrono::milliseconds>(
+                    next_retry - chrono::steady_clock::now()).count();
+            timeout_ms = static_cast<int>(max(0L, min(until_retry, static_cast<long>(timeout_ms))));
         }
-        if (!options_->verbose_) fclose(f);
-        curl_easy_cleanup(curl);
+        if (in_flight > 0 && timeout_ms > 0) curl_multi_wait(multi, NULL, 0, timeout_ms, NULL);
     }
+
+    curl_multi_cleanup(multi);
 }
 
-// Replace $RNUM with random numbers
-string Worker::ReplaceRNUM(const string in) {
-    random_device rd;
+bool Worker::TakeRequest() {
+    if (stats_->Stopped()) return false;
+    if (replay_ && !replay_pending_ && !(replay_pending_ = replay_->Take(&replay_entry_))) return false;
+    return stats_->CountRequest() < options_->num_recurrence_;
+}
 
-    string from = "$RNUM";
-    string subject = in;
-    string::size_type pos = subject.find(from);
+chrono::steady_clock::time_point Worker::NextSendTime() {
+    if (!replay_) return scheduler_.Next();
+    // Read the next request of the log ahead, once the log is done the time is past so that TakeRequest tells so
+    if (!replay_pending_) replay_pending_ = replay_->Take(&replay_entry_);
+    return replay_pending_ ? replay_entry_.due : chrono::steady_clock::time_point();
+}
+
+bool Worker::SleepUntil(chrono::steady_clock::time_point time) {
+    // A long gap in the log is slept in steps, so that the end of the run is not missed
+    while (chrono::steady_clock::now() < time) {
+        if (stats_->Stopped()) return false;
+        this_thread::sleep_until(min(time, chrono::steady_clock::now() + chrono::milliseconds(100)));
+    }
+    return true;
+}
 
-    while (pos != string::npos) {
-        string to = to_string(rd() % 256);
-        subject.replace(pos, from.size(), to);
-        pos = subject.find(from, pos + to.size());
+bool Worker::IsActive() const {
+    return id_ < profile_->ActiveThreads();
+}
+
+bool Worker::WaitUntilActive() {
+    if (IsActive()) return true;
+    while (!IsActive()) {
+        if (stats_->Stopped() || stats_->Requests() >= options_->num_recurrence_) return false;
+        this_thread::sleep_for(chrono::milliseconds(10));
     }
+    // Start the schedule afresh rather than catching up with the sends of the pause
+    scheduler_.Start(chrono::steady_clock::now());
+    return true;
+}
 
-    return subject;
+void Worker::ApplyLevel(chrono::steady_clock::time_point now) {
+    u_long generation = profile_->Generation();
+    if (generation == generation_) return;
+    generation_ = generation;
+    if (open_loop_ && !replay_) scheduler_.SetRate(profile_->Rate() / profile_->ActiveThreads(), now);
 }
 
-// Replace $RDICT with randomly selected strings
-string Worker::ReplaceRDICT(const string in) {
-    random_device rd;
+// Create an easy handle with the options common to every request
+bool Worker::InitTransfer(Transfer *transfer) {
+    CURL *curl = curl_easy_init();
+    transfer->curl = curl;
+    if (!curl) return false;
+
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+
+    // Scan the response as it arrives instead of writing it anywhere
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteResponse);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer);
+
+    // Enable basic auth
+    if (!options_->http_user_.empty()) {
+        curl_easy_setopt(curl, CURLOPT_USERPWD, options_->http_user_.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist_);
+
+    // Keep a connection open to each node while the requests go round them
+    if (options_->max_connections_ > 0) {
+        curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, static_cast<long>(options_->max_connections_));
+    } else if (balancer_->Size() > 1) {
+        curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, static_cast<long>(balancer_->Size()));
+    }
+
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, options_->curl_http_version_);
+    // Wait for a connection to multiplex on rather than opening another one
+    if (options_->curl_http_version_ != CURL_HTTP_VERSION_1_1) curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, options_->tcp_nodelay_ ? 1L : 0L);
 
-    string from = "$RDICT";
-    string subject = in;
-    string::size_type pos = subject.find(from);
+    // Offer the encodings curl can decode, the response reaches WriteResponse decoded
+    if (options_->accept_encoding_) curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
 
-    while (pos != string::npos) {
-        string to = options_->dict_.at(rd() % options_->dict_.size());
-        subject.replace(pos, from.size(), to);
-        pos = subject.find(from, pos + to.size());
+    // Set timeout
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, static_cast<long>(options_->timeout_sec_));
+
+    // Send the body from the read callback, with chunked encoding since the size is not known in advance
+    if (options_->bulk_docs_ > 0) {
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, ReadBulk);
+        curl_easy_setopt(curl, CURLOPT_READDATA, transfer);
+        curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, SeekBulk);
+        curl_easy_setopt(curl, CURLOPT_SEEKDATA, transfer);
     }
 
-    return subject;
+    transfer->worker = this;
+    transfer->method = nullptr;
+    transfer->node = 0;
+    transfer->session = false;
+    transfer->step = 0;
+    transfer->session_failed = false;
+    transfer->retries = 0;
+    transfer->requests_sent.assign(max(balancer_->Size(), static_cast<size_t>(1)), 0);
+    transfer->capture = options_->logger_.IsOpen() ? options_->logger_.CaptureSize() : 0;
+    transfer->response.reserve(transfer->capture);
+    if (options_->gzip_request_) {
+        transfer->gzip.reset(new Gzip());
+        if (!transfer->gzip->IsReady()) {
+            safe_cerr("Error: worker " + to_string(id_) + " cannot set up gzip compression\n");
+            return false;
+        }
+    }
+    return true;
 }
 
-string Worker::ReplaceRNUMEx(const string in) {
-    random_device rd;
+// Render the next request into the buffers of the transfer
+void Worker::PrepareRequest(Transfer *transfer) {
+    if (replay_) {
+        PrepareReplay(transfer);
+        return;
+    }
+
+    // Pick a query from the workload, unless the transfer is going through the pages of a session
+    if (!transfer->session) {
+        transfer->query = options_->workload_.Pick(&random_);
+        const Query &picked = options_->workload_.At(transfer->query);
+        if (picked.IsSession()) {
+            transfer->session = true;
+            transfer->step = picked.open.defined ? 0 : 1;
+            transfer->session_failed = false;
+            transfer->values = SessionValues();
+        }
+    }
+    const Query &query = options_->workload_.At(transfer->query);
+
+    // The first page is the query itself, the other steps fill in the values of the previous response
+    const string *method = &query.method;
+    const Template *url_template = &query.url_template;
+    const Template *body_template = &query.body_template;
+    const SessionValues *values = nullptr;
+    bool precompressed = query.precompressed;
+    if (transfer->session) {
+        values = &transfer->values;
+        const Step *step = nullptr;
+        if (transfer->step == 0) {
+            step = &query.open;
+        } else if (transfer->step > query.pages) {
+            step = &query.close;
+        } else if (transfer->step > 1) {
+            step = &query.next;
+        }
+        if (step) {
+            method = &step->method;
+            url_template = &step->url_template;
+            body_template = &step->body_template;
+            precompressed = false;
+        }
+    }
+
+    transfer->scanner.Reset(transfer->session);
+    transfer->download_decoded = 0;
+    transfer->response.clear();
+
+    // Supply random numbers and strings, the bulk body is rendered while it is sent
+    url_template->Render(&random_, &sequence_, &transfer->url, values);
+    if (balancer_->Size() > 0) {
+        transfer->node = balancer_->Acquire(&random_, &node_cursor_);
+        balancer_->Route(transfer->node, &transfer->url);
+    }
+    if (options_->bulk_docs_ > 0) {
+        RewindBulk(transfer);
+    } else {
+        body_template->Render(&random_, &sequence_, &transfer->body, values);
+        transfer->body_decoded = transfer->body.size();
+    }
 
-    string from = "$RNUM(";
-    string subject = in;
-    string::size_type s_pos = subject.find(from);
+    // Set the method explicitly, only when it changes since curl copies it
+    if (transfer->method != method) {
+        curl_easy_setopt(transfer->curl, CURLOPT_CUSTOMREQUEST, method->c_str());
+        transfer->method = method;
+    }
 
-    while (s_pos != string::npos) {
-        string::size_type e_pos = subject.find(")", s_pos);
-        int m = atoi(subject.substr(s_pos + from.size(), e_pos).c_str());
-        string to;
-        if (m > 0) {
-            to = to_string(rd() % m);
-        }else{
-            to = "";
+    FinishRequest(transfer, precompressed ? &query.body_gzip : nullptr);
+}
+
+// Send the request of the log as it was captured
+void Worker::PrepareReplay(Transfer *transfer) {
+    transfer->query = 0;
+    transfer->scanner.Reset();
+    transfer->download_decoded = 0;
+    transfer->response.clear();
+    transfer->url = replay_entry_.url;
+    transfer->body = replay_entry_.body;
+    transfer->body_decoded = transfer->body.size();
+    if (balancer_->Size() > 0) {
+        transfer->node = balancer_->Acquire(&random_, &node_cursor_);
+        balancer_->Route(transfer->node, &transfer->url);
+    }
+
+    // The methods of the log come and go, so that none is kept to compare with
+    curl_easy_setopt(transfer->curl, CURLOPT_CUSTOMREQUEST, replay_entry_.method.c_str());
+    transfer->method = nullptr;
+
+    FinishRequest(transfer, nullptr);
+}
+
+// Set the URL and the body of the request rendered, whether from the workload or from the log
+void Worker::FinishRequest(Transfer *transfer, const string *precompressed) {
+    if(options_->verbose_){
+        stringstream msg_url;
+        msg_url << this_thread::get_id() << " URL: " << transfer->url << endl;
+        safe_cout(msg_url.str());
+        stringstream msg_body;
+        if (options_->bulk_docs_ > 0) {
+            msg_body << this_thread::get_id() << " Bulk: " << options_->bulk_docs_ << " documents" << endl;
+        } else {
+            msg_body << this_thread::get_id() << " Body: " << transfer->body << endl;
+        }
+        safe_cout(msg_body.str());
+    }
+
+    CountConnectionRequest(transfer);
+
+    // Set the URL and the body
+    curl_easy_setopt(transfer->curl, CURLOPT_URL, transfer->url.c_str());
+    if (options_->bulk_docs_ > 0) return;
+
+    // Compress the body unless it was done once for all the requests
+    const string *body = &transfer->body;
+    if (options_->gzip_request_) {
+        if (precompressed) {
+            body = precompressed;
+        } else {
+            transfer->wire.clear();
+            transfer->gzip->Compress(transfer->body.data(), transfer->body.size(), &transfer->wire);
+            body = &transfer->wire;
+        }
+    }
+    curl_easy_setopt(transfer->curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body->size()));
+    curl_easy_setopt(transfer->curl, CURLOPT_POSTFIELDS, body->data());
+}
+
+size_t Worker::WriteResponse(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    Transfer *transfer = static_cast<Transfer *>(userdata);
+    transfer->scanner.Scan(ptr, size * nmemb);
+    transfer->download_decoded += size * nmemb;
+    // Keep the head of the response for the log, into the buffer reserved
+    if (transfer->response.size() < transfer->capture) {
+        transfer->response.append(ptr, min(size * nmemb, transfer->capture - transfer->response.size()));
+    }
+
+    // Show the response only in verbose logging
+    if (transfer->worker->options_->verbose_) {
+        lock_guard<mutex> lock(*transfer->worker->mtx_for_cout_);
+        cout.write(ptr, size * nmemb);
+    }
+    return size * nmemb;
+}
+
+size_t Worker::ReadBulk(char *buffer, size_t size, size_t nitems, void *userdata) {
+    Transfer *transfer = static_cast<Transfer *>(userdata);
+    size_t capacity = size * nitems;
+    size_t written = 0;
+
+    // The compressed stream is sent out of wire, the plain documents out of body
+    const string &source = transfer->gzip ? transfer->wire : transfer->body;
+    size_t &pos = transfer->gzip ? transfer->wire_pos : transfer->body_pos;
+
+    while (written < capacity) {
+        if (pos == source.size()) {
+            if (!transfer->worker->NextBulkChunk(transfer)) break;
+            continue;
+        }
+        size_t length = min(capacity - written, source.size() - pos);
+        memcpy(buffer + written, source.data() + pos, length);
+        pos += length;
+        written += length;
+    }
+    return written;
+}
+
+int Worker::SeekBulk(void *userdata, curl_off_t offset, int origin) {
+    if (offset != 0 || origin != SEEK_SET) return CURL_SEEKFUNC_CANTSEEK;
+    Transfer *transfer = static_cast<Transfer *>(userdata);
+    transfer->worker->RewindBulk(transfer);
+    return CURL_SEEKFUNC_OK;
+}
+
+void Worker::RewindBulk(Transfer *transfer) {
+    transfer->docs_left = options_->bulk_docs_;
+    transfer->body.clear();
+    transfer->body_pos = 0;
+    transfer->body_decoded = 0;
+    if (transfer->gzip) {
+        transfer->gzip->Reset();
+        transfer->wire.clear();
+        transfer->wire_pos = 0;
+        transfer->gzip_finished = false;
+    }
+}
+
+bool Worker::NextBulkChunk(Transfer *transfer) {
+    if (transfer->docs_left > 0) {
+        RenderBulkDocument(transfer);
+        transfer->body_decoded += transfer->body.size();
+        if (transfer->gzip) {
+            // deflate may keep the whole document buffered, which leaves wire empty for the next round
+            transfer->wire.clear();
+            transfer->wire_pos = 0;
+            transfer->gzip->Append(transfer->body.data(), transfer->body.size(), &transfer->wire);
+        }
+        return true;
+    }
+    if (transfer->gzip && !transfer->gzip_finished) {
+        transfer->wire.clear();
+        transfer->wire_pos = 0;
+        transfer->gzip->Finish(&transfer->wire);
+        transfer->gzip_finished = true;
+        return true;
+    }
+    return false;
+}
+
+// Render an action line with a random _id followed by the document into the reused buffer
+void Worker::RenderBulkDocument(Transfer *transfer) {
+    static const char HEX[] = "0123456789abcdef";
+    string &body = transfer->body;
+
+    body.assign("{\"index\":{\"_id\":\"");
+    uint64_t id = random_.Next();
+    for (int shift = 60; shift >= 0; shift -= 4) body += HEX[(id >> shift) & 0xf];
+    body.append("\"}}\n");
+    options_->workload_.At(transfer->query).body_template.RenderAppend(&random_, &sequence_, &body);
+    body += '\n';
+
+    transfer->body_pos = 0;
+    transfer->docs_left--;
+}
+
+void Worker::ScheduleRequest(Transfer *transfer, chrono::steady_clock::time_point now) {
+    if (!open_loop_) {
+        transfer->intended = now;
+        return;
+    }
+    if (replay_) {
+        // Late against the timeline of the log, the request is taken off it
+        transfer->intended = replay_entry_.due;
+        stats_->CountLateness(id_, chrono::duration<double>(now - replay_entry_.due).count());
+        replay_pending_ = false;
+        return;
+    }
+    transfer->intended = scheduler_.Next();
+    stats_->CountSchedule(id_, scheduler_.Lag(now), scheduler_.Interval());
+    scheduler_.Advance();
+}
+
+bool Worker::CountResult(Transfer *transfer, CURLcode cr) {
+    CURL *curl = transfer->curl;
+    stringstream msg_response;
+    RequestResult result;
+    result.query = transfer->query;
+    result.retries = transfer->retries;
+    if (balancer_->Size() > 0) {
+        result.node = transfer->node;
+        balancer_->Release(transfer->node);
+    }
+
+    // Count connection churn whatever the outcome
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    result.connects = static_cast<u_long>(connects);
+
+    // The body of an HTTP error is read as well, so that a rejection is told from a bad query
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    result.status = status;
+    result.curl_code = static_cast<int>(cr);
+    result.rejections = static_cast<u_long>(transfer->scanner.Rejections());
+
+    // curl and HTTP errors
+    if (cr == CURLE_OK && status >= 400) {
+        msg_response << "Error: HTTP response (" << status;
+        if (!transfer->scanner.ErrorType().empty()) msg_response << " " << transfer->scanner.ErrorType();
+        msg_response << ")" << endl;
+        result.error_http = 1;
+    } else if (cr == CURLE_OK) {
+        long sizeUpload;
+        curl_off_t sizeUploadBody;
+        curl_off_t sizeDownload;
+        long sizeReceivedHeader;
+        double transferTime;
+        curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &sizeUpload);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &sizeUploadBody);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &sizeDownload);
+        curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &sizeReceivedHeader);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &transferTime);
+        // A successful HTTP response may still report a failure in its body
+        if (transfer->scanner.IsPartialFailure()) {
+            msg_response << "Error: partial failure (timed_out: " << boolalpha << transfer->scanner.TimedOut()
+                         << ", _shards.failed: " << transfer->scanner.ShardsFailed() << ", errors: "
+                         << transfer->scanner.Errors();
+            if (!transfer->scanner.ErrorType().empty()) msg_response << ", " << transfer->scanner.ErrorType();
+            msg_response << ")" << endl;
+            result.error_partial = 1;
+        } else {
+            result.success = 1;
+            result.docs = options_->bulk_docs_;
         }
-        subject.replace(s_pos, e_pos - s_pos +1, to);
-        s_pos = subject.find(from, s_pos + to.size());
+        if (transfer->scanner.Took() >= 0) result.time_took = transfer->scanner.Took() / 1000.0;
+        result.size_upload = static_cast<u_long>(sizeUpload + sizeUploadBody);
+        result.size_download = static_cast<u_long>(sizeDownload + sizeReceivedHeader);
+        result.size_upload_decoded = static_cast<u_long>(sizeUpload) + transfer->body_decoded;
+        result.size_download_decoded = static_cast<u_long>(sizeReceivedHeader) + transfer->download_decoded;
+        result.time_transfer = transferTime;
+        MeasurePhases(curl, &result);
+        // Latency from the intended send time, which includes any wait behind a stalled server
+        result.time_response = chrono::duration<double>(chrono::steady_clock::now() - transfer->intended).count();
+    } else {
+        msg_response << "Error: curl_easy_perform() returned (" << cr << ") " << curl_easy_strerror(cr) << endl;
+        result.error_curl = 1;
+    }
+
+    // Every request earns the budget its share of a retry, which a failure the policy retries spends
+    const RetryPolicy &policy = options_->retry_;
+    if (transfer->retries == 0) retry_budget_.Deposit();
+    if (policy.IsEnabled() && RetryPolicy::IsRetryable(status, cr) && transfer->retries < policy.MaxRetries() &&
+        !stats_->Stopped()) {
+        result.retrying = retry_budget_.Withdraw();
+        result.retry_denied = !result.retrying;
+    }
+    stats_->CountAttempt(id_, result);
+    if (options_->logger_.IsOpen()) Log(transfer, result);
+
+    if (result.retrying) {
+        if (options_->verbose_) safe_cerr(msg_response.str());
+        double backoff = policy.Backoff(transfer->retries, &random_);
+        transfer->retry_at = chrono::steady_clock::now() +
+                             chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(backoff));
+        transfer->retries++;
+        transfer->failure = result;
+        return true;
     }
+    if (!msg_response.str().empty()) safe_cerr(msg_response.str());
+    AdvanceSession(transfer, &result);
+    stats_->CountResult(id_, result);
+    transfer->retries = 0;
+    return false;
+}
+
+// Copy the request into an entry of the logger if it is sampled, the file is written by a thread of its own
+void Worker::Log(Transfer *transfer, const RequestResult &result) {
+    Logger &logger = options_->logger_;
+    double total = 0.0;
+    curl_easy_getinfo(transfer->curl, CURLINFO_TOTAL_TIME, &total);
+    double latency = open_loop_ ? chrono::duration<double>(chrono::steady_clock::now() - transfer->intended).count()
+                                : total;
+    Logger::Reason reason;
+    if (!logger.Sample(&logged_, !result.success, latency, &reason)) return;
+    Logger::Entry *entry = logger.Acquire(id_);
+    if (!entry) return;
+
+    entry->timestamp = chrono::duration_cast<chrono::microseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+    entry->worker = id_;
+    entry->label = replay_ ? nullptr : &options_->workload_.At(transfer->query).label;
+    entry->status = result.status;
+    entry->curl_code = result.curl_code;
+    entry->retries = transfer->retries;
+    entry->latency = latency;
+    entry->reason = reason;
+    char *method = nullptr;
+    curl_easy_getinfo(transfer->curl, CURLINFO_EFFECTIVE_METHOD, &method);
+    entry->method.assign(method ? method : "");
+    entry->url.assign(transfer->url);
+    // A bulk body is rendered a document at a time, the one sent last is at hand
+    entry->request.assign(transfer->body, 0, logger.CaptureSize());
+    entry->response.assign(transfer->response);
+    logger.Commit(id_);
+}
+
+void Worker::GiveUp(Transfer *transfer) {
+    RequestResult result = transfer->failure;
+    result.retrying = false;
+    AdvanceSession(transfer, &result);
+    stats_->CountResult(id_, result);
+    transfer->retries = 0;
+}
+
+void Worker::PrepareRetry(Transfer *transfer) {
+    transfer->scanner.Reset(transfer->session);
+    transfer->download_decoded = 0;
+    transfer->response.clear();
+    // Another node may take the request, as the production clients go round them
+    if (balancer_->Size() > 0) {
+        transfer->node = balancer_->Acquire(&random_, &node_cursor_);
+        balancer_->Route(transfer->node, &transfer->url);
+        curl_easy_setopt(transfer->curl, CURLOPT_URL, transfer->url.c_str());
+    }
+    CountConnectionRequest(transfer);
+    if (options_->bulk_docs_ > 0) RewindBulk(transfer);
+}
 
-    return subject;
+// Close the connection after every requests_per_connection_ requests to its node, so that the next one opens afresh.
+// Over HTTP/1.1 a transfer has a single request in flight, so a connection to each node serves its requests there
+void Worker::CountConnectionRequest(Transfer *transfer) {
+    if (options_->requests_per_connection_ == 0) return;
+    u_long sent = ++transfer->requests_sent[transfer->node];
+    bool last = sent % options_->requests_per_connection_ == 0;
+    curl_easy_setopt(transfer->curl, CURLOPT_FORBID_REUSE, last ? 1L : 0L);
+}
+
+void Worker::AdvanceSession(Transfer *transfer, RequestResult *result) {
+    if (!transfer->session) return;
+    const Query &query = options_->workload_.At(transfer->query);
+    bool closing = transfer->step > query.pages;
+    // Closes of all the queries share the slot after the deepest page
+    result->step = closing ? static_cast<int>(options_->workload_.MaxPages()) + 1 : static_cast<int>(transfer->step);
+
+    const ResponseScanner &scanner = transfer->scanner;
+    bool answered = result->success || result->error_partial;
+    if (answered) {
+        if (!scanner.ScrollId().empty()) transfer->values.scroll_id = scanner.ScrollId();
+        if (!scanner.PitId().empty()) transfer->values.pit_id = scanner.PitId();
+        if (!scanner.Sort().empty()) transfer->values.sort = scanner.Sort();
+    }
+
+    bool next_step = false;
+    if (closing) {
+        // The session ends with its close, whatever the outcome
+    } else if (!answered) {
+        // Still release a context that was opened, so that it does not pile up on the cluster
+        transfer->session_failed = true;
+        next_step = query.close.defined && (!transfer->values.scroll_id.empty() || !transfer->values.pit_id.empty());
+        if (next_step) transfer->step = query.pages + 1;
+    } else if (transfer->step < query.pages && !(transfer->step >= 1 && scanner.Hits() == 0)) {
+        transfer->step++;
+        next_step = true;
+    } else if (query.close.defined) {
+        // The last page, or one without any more hits
+        transfer->step = query.pages + 1;
+        next_step = true;
+    }
+    if (next_step) return;
+    result->session_end = transfer->session_failed ? SESSION_FAILED : SESSION_COMPLETED;
+    transfer->session = false;
+}
+
+// Split the cumulative curl timings into the time spent in every phase
+void Worker::MeasurePhases(CURL *curl, RequestResult *result) {
+    curl_off_t lookup = 0, connect = 0, tls = 0, pretransfer = 0, ttfb = 0, total = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+
+    // A phase which did not happen, such as TLS over plain HTTP or a connect on a reused connection, stays 0
+    curl_off_t ends[PHASE_COUNT] = {lookup, connect, tls, pretransfer, ttfb, total};
+    curl_off_t prev = 0;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (ends[i] <= 0) continue;
+        result->time_phases[i] = ends[i] > prev ? (ends[i] - prev) / 1000000.0 : 0.0;
+        prev = max(prev, ends[i]);
+    }
 }
 
 void Worker::safe_cout(const string msg) {
@@ -7,12 +7,19 @@
 
 #include <iostream>
 #include <curl/curl.h>
-#include <random>
+#include <cstring>
 #include <sstream>
 #include <thread>
 
 #include "Options.h"
 #include "Stats.h"
+#include "Random.h"
+#include "Scheduler.h"
+#include "ResponseScanner.h"
+#include "Balancer.h"
+#include "Profile.h"
+#include "Gzip.h"
+#include "Replay.h"
 
 using namespace std;
 
@@ -20,20 +27,153 @@ class Worker {
 public:
     Worker(Stats *stats, Options *options);
 
-    Worker(Stats *stats_, Options *options_, mutex *mtx_for_cout_);
+    Worker(Stats *stats_, Options *options_, Balancer *balancer_, Profile *profile_, mutex *mtx_for_cout_, u_int id_);
 
     void Run();
 
 private:
+    // An in-flight request, which owns the buffers curl reads from until it completes
+    struct Transfer {
+        CURL *curl;
+        string url;
+        string body;
+        // Latency is measured from here, the scheduled time in the open-loop mode
+        chrono::steady_clock::time_point intended;
+        // Index of the query in the workload
+        size_t query;
+        // Index of the node, when the requests are balanced over nodes
+        size_t node;
+        const string *method;
+        // Bulk documents still to stream and the position in the current one, which is rendered into body
+        Worker *worker;
+        u_long docs_left;
+        size_t body_pos;
+        ResponseScanner scanner;
+        // Compressed body when gzip is on, streamed out of wire in the bulk mode
+        unique_ptr<Gzip> gzip;
+        string wire;
+        size_t wire_pos;
+        bool gzip_finished;
+        // Bytes of the body before compression, and of the response after decoding
+        u_long body_decoded;
+        u_long download_decoded;
+        // Session the transfer goes through, and its step sent: 0 for the open, the page, or pages + 1 for the close
+        bool session;
+        u_int step;
+        bool session_failed;
+        SessionValues values;
+        // Retries sent so far, and the time of the next one with the failure it follows
+        u_int retries;
+        chrono::steady_clock::time_point retry_at;
+        RequestResult failure;
+        // Requests sent to each node, to close the connection to it every requests_per_connection_
+        vector<u_long> requests_sent;
+        // Head of the response kept for the log, up to capture bytes
+        string response;
+        size_t capture;
+    };
+
     Stats *stats_;
     Options *options_;
+    Balancer *balancer_;
+    Profile *profile_;
     mutex *mtx_for_cout_;
+    u_int id_;
+    Random random_;
+    // Retries this thread may still send
+    RetryBudget retry_budget_;
+    // Next value of $SEQ in the requests of this thread
+    u_long sequence_ = 0;
+    // Round-robin position over the nodes, starting apart in every thread
+    size_t node_cursor_;
+
+    // Send times when a request rate is given or a log is replayed, otherwise the next request follows the previous one
+    bool open_loop_;
+    Scheduler scheduler_;
+    // Next request of the log, taken ahead so that its send time is known
+    Replay *replay_ = nullptr;
+    Replay::Entry replay_entry_;
+    bool replay_pending_ = false;
+    // Level of the profile applied last
+    u_long generation_ = 0;
+    // Requests completed, for the 1 in N requests the logger samples
+    u_long logged_ = 0;
+
+    struct curl_slist *slist_ = nullptr;
+    vector<Transfer> transfers_;
+
+    // Perform one request at a time with curl_easy_perform
+    void RunEasy();
+
+    // Keep connections_ requests in flight with the curl_multi interface
+    void RunMulti();
+
+    // Take a request out of the budget, false once it is used up, the log is done or the run is stopped
+    bool TakeRequest();
+
+    // Time to send the next request in the open-loop mode
+    chrono::steady_clock::time_point NextSendTime();
+
+    // Sleep until the time, return false if the run is stopped meanwhile
+    bool SleepUntil(chrono::steady_clock::time_point time);
+
+    // The stage runs this thread
+    bool IsActive() const;
+
+    // Pause while the stage runs fewer threads, return false if the run ends meanwhile
+    bool WaitUntilActive();
+
+    // Follow a change of the load level, the rate is shared by the active threads
+    void ApplyLevel(chrono::steady_clock::time_point now);
+
+    bool InitTransfer(Transfer *transfer);
+
+    void PrepareRequest(Transfer *transfer);
+
+    void PrepareReplay(Transfer *transfer);
+
+    // Shared tail of both, precompressed is the body gzipped once for all the requests, null if none
+    void FinishRequest(Transfer *transfer, const string *precompressed);
+
+    // Take the next send time, or the current time in the closed-loop mode
+    void ScheduleRequest(Transfer *transfer, chrono::steady_clock::time_point now);
+
+    // Count the attempt, true if the policy sends the request again at retry_at
+    bool CountResult(Transfer *transfer, CURLcode cr);
+
+    // Hand the request over to the logger if it is sampled
+    void Log(Transfer *transfer, const RequestResult &result);
+
+    // Count the failure a retry follows as the outcome, once the run ends before the retry is sent
+    void GiveUp(Transfer *transfer);
+
+    // Send the request of the transfer again as it was rendered
+    void PrepareRetry(Transfer *transfer);
+
+    // Count a request sent to the node of the transfer, and close the connection after it if -k says so
+    void CountConnectionRequest(Transfer *transfer);
+
+    // Take the values of the response and move the session to its next step
+    void AdvanceSession(Transfer *transfer, RequestResult *result);
+
+    static void MeasurePhases(CURL *curl, RequestResult *result);
+
+    // Receive the response body, which is scanned for the Elasticsearch metadata
+    static size_t WriteResponse(char *ptr, size_t size, size_t nmemb, void *userdata);
+
+    // Stream the _bulk body one document at a time through CURLOPT_READFUNCTION
+    static size_t ReadBulk(char *buffer, size_t size, size_t nitems, void *userdata);
+
+    // Restart the _bulk body when curl resends the request
+    static int SeekBulk(void *userdata, curl_off_t offset, int origin);
 
-    string ReplaceRNUM(const string in);
+    // Start the _bulk body over
+    void RewindBulk(Transfer *transfer);
 
-    string ReplaceRNUMEx(const string in);
+    // Fill the buffer to send next with a document, or the end of the compressed stream, false at the end
+    bool NextBulkChunk(Transfer *transfer);
 
-    string ReplaceRDICT(const string in);
+    void RenderBulkDocument(Transfer *transfer);
 
     void safe_cout(const string msg);
 
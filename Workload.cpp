@@ -0,0 +1,209 @@
+//
+// Weighted mix of request templates
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+
+#include "Workload.h"
+#include "Json.h"
+
+// url of the members, or path appended to the scheme, host and port of base_url
+static string ResolveUrl(map<string, JsonValue> &members, const string &base_url) {
+    string url = base_url;
+    if (members.count("url")) {
+        url = members["url"].text;
+    } else if (members.count("path")) {
+        string path = members["path"].text;
+        url = base_url.substr(0, base_url.find('/', base_url.find("://") + 3));
+        if (path.empty() || path[0] != '/') url += "/";
+        url += path;
+    }
+    return url;
+}
+
+// Read a step of a session, which inherits what it omits from the defaults given
+static bool ParseStep(map<string, JsonValue> &members, const string &name, const string &method, const string &url,
+                      const string &body, const string &base_url, Step *step, string *error) {
+    if (!members.count(name) || members[name].type == JsonValue::NIL) return true;
+    map<string, JsonValue> fields;
+    string parse_error;
+    if (members[name].type != JsonValue::OBJECT) {
+        *error = "\"" + name + "\" must be an object";
+        return false;
+    }
+    if (!Json::ParseObject(members[name].text, &fields, &parse_error)) {
+        *error = "\"" + name + "\": " + parse_error;
+        return false;
+    }
+    if (url.empty() && !fields.count("url") && !fields.count("path")) {
+        *error = "\"" + name + "\" needs a url or a path";
+        return false;
+    }
+    step->defined = true;
+    step->method = fields.count("method") ? fields["method"].text : method;
+    step->url = fields.count("url") || fields.count("path") ? ResolveUrl(fields, base_url) : url;
+    step->body = fields.count("body") && fields["body"].type != JsonValue::NIL ? fields["body"].text : body;
+    return true;
+}
+
+void Workload::AddQuery(const string &label, const string &method, const string &url, const string &body,
+                        const double weight) {
+    Query query;
+    query.label = label;
+    query.method = method;
+    query.url = url;
+    query.body = body;
+    query.weight = weight;
+    queries_.push_back(query);
+}
+
+bool Workload::Load(const string &filename, const string &default_method, const string &base_url, string *error) {
+    ifstream if_workload(filename);
+    if (!if_workload) {
+        *error = "cannot open " + filename;
+        return false;
+    }
+
+    int line_number = 0;
+    for (string str_line; getline(if_workload, str_line);) {
+        line_number++;
+        if (str_line.find_first_not_of(" \t\r") == string::npos) continue;
+
+        map<string, JsonValue> members;
+        string parse_error;
+        if (!Json::ParseObject(str_line, &members, &parse_error)) {
+            *error = filename + ":" + to_string(line_number) + ": " + parse_error;
+            return false;
+        }
+
+        string url = ResolveUrl(members, base_url);
+
+        double weight = members.count("weight") ? atof(members["weight"].text.c_str()) : 1.0;
+        if (weight <= 0) {
+            *error = filename + ":" + to_string(line_number) + ": weight must be positive";
+            return false;
+        }
+
+        string label = members.count("label") ? members["label"].text : "query" + to_string(queries_.size() + 1);
+        string method = members.count("method") ? members["method"].text : default_method;
+        string body = members.count("body") && members["body"].type != JsonValue::NIL ? members["body"].text : "";
+        AddQuery(label, method, url, body, weight);
+
+        // Pages of a session follow on from the first by default, the context is opened and closed by the ones given
+        Query &query = queries_.back();
+        int pages = members.count("pages") ? atoi(members["pages"].text.c_str()) : 1;
+        string step_error;
+        if (pages < 1) {
+            step_error = "pages must be positive";
+        } else {
+            query.pages = static_cast<u_int>(pages);
+            if (ParseStep(members, "open", "POST", "", "", base_url, &query.open, &step_error) &&
+                ParseStep(members, "next", method, url, body, base_url, &query.next, &step_error) &&
+                ParseStep(members, "close", "DELETE", "", "", base_url, &query.close, &step_error)) {
+                if (!query.next.defined) {
+                    query.next.method = method;
+                    query.next.url = url;
+                    query.next.body = body;
+                }
+            }
+        }
+        if (!step_error.empty()) {
+            *error = filename + ":" + to_string(line_number) + ": " + step_error;
+            return false;
+        }
+    }
+
+    if (queries_.empty()) {
+        *error = filename + ": no queries";
+        return false;
+    }
+    return true;
+}
+
+// Build the alias table with Vose's method
+void Workload::Compile(const Dictionary *dict) {
+    double total = 0.0;
+    for (Query &query : queries_) {
+        bool session = query.IsSession();
+        query.url_template.Compile(query.url, dict, session);
+        query.body_template.Compile(query.body, dict, session);
+        for (Step *step : {&query.open, &query.next, &query.close}) {
+            step->url_template.Compile(step->url, dict, session);
+            step->body_template.Compile(step->body, dict, session);
+        }
+        total += query.weight;
+    }
+
+    size_t n = queries_.size();
+    probability_.assign(n, 0.0);
+    alias_.assign(n, 0);
+
+    vector<double> scaled(n);
+    vector<size_t> small;
+    vector<size_t> large;
+    for (size_t i = 0; i < n; i++) {
+        scaled[i] = queries_[i].weight * n / total;
+        if (scaled[i] < 1.0) {
+            small.push_back(i);
+        } else {
+            large.push_back(i);
+        }
+    }
+    while (!small.empty() && !large.empty()) {
+        size_t s = small.back();
+        small.pop_back();
+        size_t l = large.back();
+        large.pop_back();
+        probability_[s] = scaled[s];
+        alias_[s] = l;
+        scaled[l] = scaled[l] + scaled[s] - 1.0;
+        if (scaled[l] < 1.0) {
+            small.push_back(l);
+        } else {
+            large.push_back(l);
+        }
+    }
+    // Left over ones are 1 apart from rounding errors
+    for (size_t i : large) probability_[i] = 1.0;
+    for (size_t i : small) probability_[i] = 1.0;
+}
+
+bool Workload::Precompress(string *error) {
+    Gzip gzip;
+    if (!gzip.IsReady()) {
+        *error = "cannot set up gzip compression";
+        return false;
+    }
+    for (Query &query : queries_) {
+        if (!query.body_template.IsStatic()) continue;
+        query.body_gzip.clear();
+        gzip.Compress(query.body.data(), query.body.size(), &query.body_gzip);
+        query.precompressed = true;
+    }
+    return true;
+}
+
+size_t Workload::Pick(Random *random) const {
+    if (queries_.size() == 1) return 0;
+    size_t i = random->Uniform(queries_.size());
+    return random->NextDouble() < probability_[i] ? i : alias_[i];
+}
+
+const Query &Workload::At(size_t index) const {
+    return queries_[index];
+}
+
+size_t Workload::Size() const {
+    return queries_.size();
+}
+
+u_int Workload::MaxPages() const {
+    u_int pages = 0;
+    for (const Query &query : queries_) {
+        if (query.IsSession()) pages = max(pages, query.pages);
+    }
+    return pages;
+}
@@ -0,0 +1,80 @@
+//
+// Weighted mix of request templates
+//
+
+#ifndef ESPERF_WORKLOAD_H
+#define ESPERF_WORKLOAD_H
+
+#include <string>
+#include <vector>
+
+#include "Template.h"
+#include "Random.h"
+#include "Gzip.h"
+
+using namespace std;
+
+// Request of a session other than the first page
+struct Step {
+    bool defined = false;
+    string method;
+    string url;
+    string body;
+    Template url_template;
+    Template body_template;
+};
+
+struct Query {
+    string label;
+    string method;
+    string url;
+    string body;
+    double weight = 1.0;
+    Template url_template;
+    Template body_template;
+    // gzip of a body without placeholders, compressed once for all the requests
+    string body_gzip;
+    bool precompressed = false;
+    // Session of up to pages requests, each but the first sent as next with the values of the previous response,
+    // between an optional open, such as of a point in time, and a close releasing the context
+    u_int pages = 1;
+    Step open;
+    Step next;
+    Step close;
+
+    bool IsSession() const { return pages > 1 || open.defined || close.defined; }
+};
+
+class Workload {
+public:
+    // Single query given on the command line and stdin
+    void AddQuery(const string &label, const string &method, const string &url, const string &body,
+                  const double weight);
+
+    // Read NDJSON lines of {"label", "method", "url" or "path", "weight", "body", "pages", "open", "next", "close"},
+    // a path is appended to base_url, and the steps of a session are objects of "method", "url" or "path", "body"
+    bool Load(const string &filename, const string &default_method, const string &base_url, string *error);
+
+    // Compile the templates and build the alias table
+    void Compile(const Dictionary *dict);
+
+    // Compress the bodies which render the same every time, false if zlib cannot be set up
+    bool Precompress(string *error);
+
+    // Pick a query in proportion to the weights in O(1)
+    size_t Pick(Random *random) const;
+
+    const Query &At(size_t index) const;
+
+    size_t Size() const;
+
+    // Most pages of a session over the queries, 0 without sessions
+    u_int MaxPages() const;
+
+private:
+    vector<Query> queries_;
+    vector<double> probability_;
+    vector<size_t> alias_;
+};
+
+#endif //ESPERF_WORKLOAD_H
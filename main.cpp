@@ -2,6 +2,7 @@
 
 #include "Options.h"
 #include "Esperf.h"
+#include "Agent.h"
 
 using namespace std;
 
@@ -14,9 +15,14 @@ int main(int argc, char **argv) {
     // parse command line options_
     Options options;
     if (options.Parse(argc, argv) == EXIT_SUCCESS){
+        // wait for a coordinator to hand over the options
+        if (options.agent_port_ > 0) {
+            Agent agent(options.agent_host_, options.agent_port_);
+            return agent.Run();
+        }
         // run esperf
         Esperf esperf(&options);
-        esperf.Run();
+        return esperf.Run();
     };
 
     return EXIT_SUCCESS;